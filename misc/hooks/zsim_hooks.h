@@ -14,6 +14,7 @@
 #define ZSIM_MAGIC_OP_HEARTBEAT         (1028)
 #define ZSIM_MAGIC_OP_WORK_BEGIN        (1029) //ubik
 #define ZSIM_MAGIC_OP_WORK_END          (1030) //ubik
+#define ZSIM_MAGIC_OP_SAVE_WARM_STATE   (1034)
 
 #ifdef __x86_64__
 #define HOOKS_STR  "HOOKS"
@@ -43,6 +44,11 @@ static inline void zsim_heartbeat() {
     zsim_magic_op(ZSIM_MAGIC_OP_HEARTBEAT);
 }
 
+static inline void zsim_save_warm_state() {
+    zsim_magic_op(ZSIM_MAGIC_OP_SAVE_WARM_STATE);
+    printf("[" HOOKS_STR "] Saved DRAM cache warm state\n");
+}
+
 static inline void zsim_work_begin() { zsim_magic_op(ZSIM_MAGIC_OP_WORK_BEGIN); }
 static inline void zsim_work_end() { zsim_magic_op(ZSIM_MAGIC_OP_WORK_END); }
 
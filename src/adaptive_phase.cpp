@@ -0,0 +1,86 @@
+#include "adaptive_phase.h"
+#include <stdio.h>
+#include <string>
+#include "bithacks.h"
+#include "config.h"
+#include "event_recorder.h"
+#include "log.h"
+#include "zsim.h"
+
+AdaptivePhaseController::AdaptivePhaseController(Config& config, uint32_t phaseLength)
+    : minLength(config.get<uint32_t>("sim.minPhaseLength", MAX(phaseLength/4, 1u))),
+      maxLength(config.get<uint32_t>("sim.maxPhaseLength", phaseLength*8)),
+      growThreshold(config.get<uint32_t>("sim.phaseGrowThreshold", 5)),
+      shrinkThreshold(config.get<uint32_t>("sim.phaseShrinkThreshold", 50))
+{
+    if (!minLength || minLength > phaseLength || phaseLength > maxLength) {
+        panic("Adaptive phases need 0 < sim.minPhaseLength (%d) <= sim.phaseLength (%d) <= sim.maxPhaseLength (%d)",
+                minLength, phaseLength, maxLength);
+    }
+    if (growThreshold >= shrinkThreshold) panic("sim.phaseGrowThreshold (%d) must be below sim.phaseShrinkThreshold (%d)", growThreshold, shrinkThreshold);
+
+    lastGapCycles = gm_calloc<uint64_t>(zinfo->numCores);
+    pendingLength = phaseLength;
+
+    traceFile = nullptr;
+    if (config.get<bool>("sim.phaseTrace", true)) {
+        traceFile = gm_strdup((std::string(zinfo->outputDir) + "/phaseLength.trace").c_str());
+        // Opened on every write, since any process may end the phase
+        FILE* f = fopen(traceFile, "w");
+        if (!f) panic("Could not open %s", traceFile);
+        fprintf(f, "# phase cycle correctionPermille newLength\n");
+        fprintf(f, "0 0 0 %d\n", phaseLength);
+        fclose(f);
+    }
+    info("Adaptive phase length: %d cycles, within [%d, %d], grow below %d/1000, shrink above %d/1000",
+            phaseLength, minLength, maxLength, growThreshold, shrinkThreshold);
+}
+
+void AdaptivePhaseController::initStats(AggregateStat* parentStat) {
+    AggregateStat* phaseStats = new AggregateStat();
+    phaseStats->init("phase", "Adaptive phase length stats");
+    auto length = makeLambdaStat([]() { return (uint64_t)zinfo->phaseLength; });
+    length->init("length", "Current phase length");
+    phaseStats->append(length);
+    profGrows.init("grows", "Phase length increases"); phaseStats->append(&profGrows);
+    profShrinks.init("shrinks", "Phase length decreases"); phaseStats->append(&profShrinks);
+    profCorrections.init("corrections", "Largest per-core weave correction, per mille of the phase, summed over phases"); phaseStats->append(&profCorrections);
+    parentStat->append(phaseStats);
+}
+
+void AdaptivePhaseController::phaseDone() {
+    // Gap cycles only grow within a run of the core, and restart from 0 when it is rescheduled
+    uint64_t maxCorrection = 0;
+    for (uint32_t i = 0; i < zinfo->numCores; i++) {
+        EventRecorder* evRec = zinfo->eventRecorders[i];
+        if (!evRec) continue;
+        uint64_t gap = evRec->getGapCycles();
+        uint64_t correction = (gap >= lastGapCycles[i])? gap - lastGapCycles[i] : gap;
+        lastGapCycles[i] = gap;
+        maxCorrection = MAX(maxCorrection, correction);
+    }
+    uint64_t permille = maxCorrection*1000/zinfo->phaseLength;
+    profCorrections.inc(permille);
+
+    uint32_t length = zinfo->nextPhaseLength;
+    uint32_t newLength = length;
+    if (permille < growThreshold) newLength = MIN(maxLength, length + MAX(length/4, 1u));
+    else if (permille > shrinkThreshold) newLength = MAX(minLength, length/2);
+    pendingLength = newLength;
+    if (newLength == length) return;
+
+    if (newLength > length) profGrows.inc();
+    else profShrinks.inc();
+    if (traceFile) {
+        FILE* f = fopen(traceFile, "a");
+        if (f) {
+            fprintf(f, "%ld %ld %ld %d\n", zinfo->numPhases, zinfo->globPhaseCycles, permille, newLength);
+            fclose(f);
+        }
+    }
+}
+
+void AdaptivePhaseController::advancePhase() {
+    zinfo->phaseLength = zinfo->nextPhaseLength;
+    zinfo->nextPhaseLength = pendingLength;
+}
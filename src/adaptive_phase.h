@@ -0,0 +1,49 @@
+#ifndef ADAPTIVE_PHASE_H_
+#define ADAPTIVE_PHASE_H_
+
+#include <stdint.h>
+#include "galloc.h"
+#include "stats.h"
+
+class Config;
+
+/* Adapts the phase length to how far the weave phase corrects the bound phase.
+ * After each weave phase, phaseDone() takes the largest per-core growth of the
+ * event recorders' gap cycles (the delay the weave phase added to the core's
+ * bound-phase timing) relative to the phase length. Below growThreshold the
+ * phase grows by 1/4, above shrinkThreshold it halves, always within
+ * [minLength, maxLength].
+ *
+ * Cores set their next phase end before the barrier, so a decision made at the
+ * end of phase N applies to phase N+2: it becomes zinfo->nextPhaseLength when
+ * phase N+1 starts (see advancePhase()).
+ */
+class AdaptivePhaseController : public GlobAlloc {
+    private:
+        const uint32_t minLength;
+        const uint32_t maxLength;
+        const uint32_t growThreshold;    // per mille of the phase length
+        const uint32_t shrinkThreshold;  // per mille of the phase length
+        const char* traceFile;           // phase length changes, in text; null if disabled
+
+        uint64_t* lastGapCycles;         // per core
+        uint32_t pendingLength;
+
+        Counter profGrows, profShrinks;
+        Counter profCorrections;         // per mille, summed over phases
+
+    public:
+        AdaptivePhaseController(Config& config, uint32_t phaseLength);
+
+        void initStats(AggregateStat* parentStat);
+
+        uint32_t getMaxLength() const { return maxLength; }
+
+        // Called at the end of each weave phase, before advancePhase()
+        void phaseDone();
+
+        // Called as globPhaseCycles moves to the next phase
+        void advancePhase();
+};
+
+#endif  // ADAPTIVE_PHASE_H_
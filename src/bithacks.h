@@ -62,6 +62,29 @@ static inline bool isPow2(T val) {
     return val && !(val & (val - 1));
 }
 
+// XOR-folds val into its low `bits` bits
+static inline uint64_t xorFold(uint64_t val, uint32_t bits) {
+    if (!bits) return 0;
+    uint64_t mask = (bits < 64)? (1ul << bits) - 1 : ~0ul;
+    uint64_t res = 0;
+    while (val) {
+        res ^= val & mask;
+        val = (bits < 64)? val >> bits : 0;
+    }
+    return res;
+}
+
+/* Permutation-based interleaving: maps unit-sized block idx to one of n units,
+ * permuting the plain idx % n order with the XOR-folded upper bits (idx / n) so
+ * that power-of-2 strides spread across units. For a given idx / n, distinct
+ * idx % n still map to distinct units, so idx / n remains a valid local index.
+ */
+static inline uint32_t hashInterleave(uint64_t idx, uint32_t n) {
+    uint64_t upper = idx / n;
+    if (isPow2(n)) return (idx ^ xorFold(upper, ilog2(n))) & (n - 1);
+    return (idx % n + xorFold(upper, 16)) % n;
+}
+
 /* Some variadic template magic for max/min with N args.
  *
  * Type-wise, you can compare multiple types (e.g., maxN(1, -7, 3.3)), but the
@@ -26,6 +26,7 @@
 #include "contention_sim.h"
 #include <algorithm>
 #include <queue>
+#include <sched.h>
 #include <sstream>
 #include <string>
 #include <typeinfo>
@@ -58,10 +59,12 @@ void ContentionSim::SimThreadTrampoline(void* arg) {
     csim->simThreadLoop(thid);
 }
 
-ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
+ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _stealing) {
     numDomains = _numDomains;
     numSimThreads = _numSimThreads;
+    stealing = _stealing;
     threadsDone = 0;
+    domainsDone = 0;
     limit = 0;
     lastLimit = 0;
     inCSim = false;
@@ -72,16 +75,21 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     for (uint32_t i = 0; i < numDomains; i++) {
         new (&domains[i].pq) PrioQueue<TimingEvent, PQ_BLOCKS>();
         domains[i].curCycle = 0;
-        futex_init(&domains[i].pqLock);
+        domains[i].syncedHead = nullptr;
+        domains[i].claimed = 0;
+        domains[i].finished = false;
+        domains[i].needsSplice = false;
+        domains[i].freeBatch.init();
     }
 
-    if ((numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
+    if (!stealing && (numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
 
     for (uint32_t i = 0; i < numSimThreads; i++) {
         futex_init(&simThreads[i].wakeLock);
         futex_lock(&simThreads[i].wakeLock); //starts locked, so first actual call to lock blocks
         simThreads[i].firstDomain = i*numDomains/numSimThreads;
         simThreads[i].supDomain = (i+1)*numDomains/numSimThreads;
+        simThreads[i].lastDomain = simThreads[i].firstDomain;
     }
 
     futex_init(&waitLock);
@@ -138,8 +146,86 @@ void ContentionSim::initStats(AggregateStat* parentStat) {
         new (&domains[i].profTime) ClockStat();
         domains[i].profTime.init("time", "Weave simulation time");
         domStat->append(&domains[i].profTime);
+        new (&domains[i].profSyncedEnqueues) Counter();
+        new (&domains[i].profSyncedRetries) Counter();
+        new (&domains[i].profMaxSplice) Counter();
+        domains[i].profSyncedEnqueues.init("syncEnq", "Events enqueued by bound-phase threads");
+        domains[i].profSyncedRetries.init("syncRetries", "Contended bound-phase enqueues (CAS retries)");
+        domains[i].profMaxSplice.init("maxSplice", "Most bound-phase events spliced in a single phase");
+        domStat->append(&domains[i].profSyncedEnqueues);
+        domStat->append(&domains[i].profSyncedRetries);
+        domStat->append(&domains[i].profMaxSplice);
         objStat->append(domStat);
     }
+    profPhaseTime.init("phaseTime", "Weave phase wall time");
+    objStat->append(&profPhaseTime);
+
+    //Event allocator stats, summed over the event recorders
+    AggregateStat* allocStat = new AggregateStat();
+    allocStat->init("evAlloc", "Timing event allocator stats");
+    auto sumRecorders = [](uint64_t (*f)(const slab::SlabAlloc&)) {
+        uint64_t res = 0;
+        for (uint32_t i = 0; i < zinfo->numCores; i++) {
+            if (zinfo->eventRecorders[i]) res += f(zinfo->eventRecorders[i]->getSlabAlloc());
+        }
+        return res;
+    };
+    auto allocBytes = makeLambdaStat([sumRecorders]() { return sumRecorders([](const slab::SlabAlloc& s) { return s.getAllocBytes(); }); });
+    allocBytes->init("bytes", "Bytes allocated");
+    auto bytesPerPhase = makeLambdaStat([sumRecorders]() {
+        uint64_t phases = zinfo->numPhases;
+        return phases? sumRecorders([](const slab::SlabAlloc& s) { return s.getAllocBytes(); })/phases : 0;
+    });
+    bytesPerPhase->init("bytesPerPhase", "Bytes allocated per phase");
+    auto totalSlabs = makeLambdaStat([sumRecorders]() { return sumRecorders([](const slab::SlabAlloc& s) { return (uint64_t)s.getTotalSlabs(); }); });
+    totalSlabs->init("slabs", "Slabs allocated");
+    auto liveSlabs = makeLambdaStat([sumRecorders]() { return sumRecorders([](const slab::SlabAlloc& s) { return (uint64_t)s.getLiveSlabs(); }); });
+    liveSlabs->init("liveSlabs", "Slabs in flight");
+    auto reclaims = makeLambdaStat([sumRecorders]() { return sumRecorders([](const slab::SlabAlloc& s) { return s.getReclaims(); }); });
+    reclaims->init("reclaims", "Slabs reclaimed");
+    auto frees = makeLambdaStat([this]() {
+        uint64_t res = 0;
+        for (uint32_t i = 0; i < numDomains; i++) res += domains[i].freeBatch.frees;
+        return res;
+    });
+    frees->init("frees", "Elements freed through domain batches");
+    auto flushes = makeLambdaStat([this]() {
+        uint64_t res = 0;
+        for (uint32_t i = 0; i < numDomains; i++) res += domains[i].freeBatch.flushes;
+        return res;
+    });
+    flushes->init("flushes", "Atomic slab updates from domain batches");
+    allocStat->append(allocBytes);
+    allocStat->append(bytesPerPhase);
+    allocStat->append(totalSlabs);
+    allocStat->append(liveSlabs);
+    allocStat->append(reclaims);
+    allocStat->append(frees);
+    allocStat->append(flushes);
+    objStat->append(allocStat);
+    for (uint32_t i = 0; i < numSimThreads; i++) {
+        std::stringstream ss;
+        ss << "thread-" << i;
+        AggregateStat* thStat = new AggregateStat();
+        thStat->init(gm_strdup(ss.str().c_str()), "Weave thread stats");
+        SimThreadData& th = simThreads[i];
+        new (&th.profBusy) ClockStat();
+        new (&th.profEvents) Counter();
+        new (&th.profSteals) Counter();
+        th.profBusy.init("busy", "Time spent simulating domains");
+        th.profEvents.init("events", "Events simulated");
+        th.profSteals.init("steals", "Domains claimed outside the thread's static range");
+        auto util = makeLambdaStat([this, &th]() {
+            uint64_t phaseNs = profPhaseTime.get();
+            return phaseNs? th.profBusy.get()*1000/phaseNs : 0;
+        });
+        util->init("util", "Busy time over weave phase time, per mille");
+        thStat->append(&th.profBusy);
+        thStat->append(&th.profEvents);
+        thStat->append(&th.profSteals);
+        thStat->append(util);
+        objStat->append(thStat);
+    }
     parentStat->append(objStat);
 }
 
@@ -157,8 +243,17 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimStart();
     }
 
+    if (stealing) {
+        domainsDone = 0;
+        for (uint32_t i = 0; i < numDomains; i++) {
+            domains[i].finished = false;
+            domains[i].needsSplice = true;
+        }
+    }
+
     inCSim = true;
     __sync_synchronize();
+    profPhaseTime.start();
 
     //Wake up sim threads
     for (uint32_t i = 0; i < numSimThreads; i++) {
@@ -168,6 +263,7 @@ void ContentionSim::simulatePhase(uint64_t limit) {
     //Sleep until phase is simulated
     futex_lock_nospin(&waitLock);
 
+    profPhaseTime.end();
     inCSim = false;
     __sync_synchronize();
 
@@ -178,6 +274,9 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimEnd();
     }
 
+    //Bulk reclamation: apply the frees batched during the phase, releasing the slabs that died in it
+    for (uint32_t i = 0; i < numDomains; i++) domains[i].freeBatch.flush();
+
     lastLimit = limit;
     __sync_synchronize();
 }
@@ -187,7 +286,7 @@ void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {
     assert(ev);
     assert_msg(cycle >= lastLimit, "Enqueued event before last limit! cycle %ld min %ld", cycle, lastLimit);
     //Hacky, but helpful to chase events scheduled too far ahead due to bugs (e.g., cycle -1). We should probably formalize this a bit more
-    assert_msg(cycle < lastLimit+10*zinfo->phaseLength+1000000, "Queued event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
+    assert_msg(cycle < lastLimit+10*zinfo->maxPhaseLength+1000000, "Queued event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
 
     assert_msg(cycle >= domains[ev->domain].curCycle, "Queued event goes back in time, cycle %ld curCycle %ld", cycle, domains[ev->domain].curCycle);
     ev->privCycle = cycle;
@@ -202,18 +301,39 @@ void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {
     assert(!inCSim);
     assert(ev && ev->domain != -1);
     assert(ev->domain < (int32_t)numDomains);
-    uint32_t domain = ev->domain;
-
-    futex_lock(&domains[domain].pqLock);
+    DomainData& domain = domains[ev->domain];
 
     assert_msg(cycle >= lastLimit, "Enqueued (synced) event before last limit! cycle %ld min %ld", cycle, lastLimit);
     //Hacky, but helpful to chase events scheduled too far ahead due to bugs (e.g., cycle -1). We should probably formalize this a bit more
-    assert_msg(cycle < lastLimit+10*zinfo->phaseLength+10000, "Queued  (synced) event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
+    assert_msg(cycle < lastLimit+10*zinfo->maxPhaseLength+10000, "Queued  (synced) event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
     ev->privCycle = cycle;
     assert(ev->numParents == 0);
-    domains[ev->domain].pq.enqueue(ev, cycle);
+    assert(!ev->next);
 
-    futex_unlock(&domains[domain].pqLock);
+    //MPSC push; pq is only touched by the domain's sim thread, in spliceSynced()
+    TimingEvent* head = domain.syncedHead;
+    while (true) {
+        ev->next = head;
+        TimingEvent* prev = __sync_val_compare_and_swap(&domain.syncedHead, head, ev);
+        if (prev == head) break;
+        head = prev;
+        domain.profSyncedRetries.atomicInc();
+    }
+}
+
+//Called by the domain's sim thread at the start of the weave phase, when no bound-phase thread is running
+void ContentionSim::spliceSynced(DomainData& domain) {
+    TimingEvent* ev = __sync_lock_test_and_set(&domain.syncedHead, nullptr);
+    uint64_t count = 0;
+    while (ev) {
+        TimingEvent* next = ev->next;
+        ev->next = nullptr;
+        domain.pq.enqueue(ev, ev->privCycle);
+        ev = next;
+        count++;
+    }
+    domain.profSyncedEnqueues.inc(count);
+    if (count > domain.profMaxSplice.get()) domain.profMaxSplice.set(count);
 }
 
 void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec) {
@@ -276,7 +396,8 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
         }
 
         //info("%d --- phase start", domain);
-        simulatePhaseThread(thid);
+        if (stealing) simulatePhaseStealing(thid);
+        else simulatePhaseThread(thid);
         //info("%d --- phase end", domain);
 
         uint32_t val = __sync_add_and_fetch(&threadsDone, 1);
@@ -291,6 +412,11 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
 void ContentionSim::simulatePhaseThread(uint32_t thid) {
     uint32_t thDomains = simThreads[thid].supDomain - simThreads[thid].firstDomain;
     uint32_t numFinished = 0;
+    uint64_t numEvents = 0;
+    simThreads[thid].profBusy.start();
+    for (uint32_t i = simThreads[thid].firstDomain; i < simThreads[thid].supDomain; i++) {
+        spliceSynced(domains[i]);
+    }
 	//printf("thDomains = %d\n", thDomains);
     if (thDomains == 1) {
         DomainData& domain = domains[simThreads[thid].firstDomain];
@@ -309,6 +435,7 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
                 domain.curCycle = cycle;
             }
             te->run(cycle);
+            numEvents++;
             uint64_t newCycle = pq.size()? pq.firstCycle() : limit;
             assert(newCycle >= domCycle);
             if (newCycle != domCycle) domain.curCycle = newCycle;
@@ -377,6 +504,7 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
                     //uint64_t nextCycle = pq.size()? pq.firstCycle() : cycle;
                     if (cycle != domain->curCycle) domain->curCycle = cycle;
                     te->run(cycle);
+                    numEvents++;
                     domain->curCycle = pq.size()? pq.firstCycle() : limit;
                     domain->queuePrio = domain->curCycle;
                     if (domain->prio == 0) domPq.push(domain);
@@ -398,6 +526,7 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
                     if (cycle != domain->curCycle) domain->curCycle = cycle;
                     te->state = EV_RUNNING;
                     te->simulate(cycle);
+                    numEvents++;
                     domain->curCycle = pq.size()? pq.firstCycle() : limit;
                     domain->queuePrio = domain->curCycle;
                     if (domain->prio == 0) domPq.push(domain);
@@ -409,10 +538,103 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
         }
     }
 
+    simThreads[thid].profEvents.inc(numEvents);
+    simThreads[thid].profBusy.end();
+
     //info("Phase done");
     __sync_synchronize();
 }
 
+/* Picks the unfinished, unclaimed domain with the lowest curCycle, preferring
+ * domains that are not stalled on a crossing, and claims it. Like the static
+ * multi-domain loop, this keeps domains close in time so crossings resolve
+ * quickly. Only curCycle, prio and the flags are read here; the pq of a domain
+ * is only touched by the thread that holds its claim.
+ */
+ContentionSim::DomainData* ContentionSim::claimDomain(uint32_t thid) {
+    DomainData* best = nullptr;
+    uint64_t bestKey = -1L;
+    uint32_t start = simThreads[thid].lastDomain;
+    for (uint32_t d = 0; d < numDomains; d++) {
+        DomainData* domain = &domains[(start + d) % numDomains]; //the domain we last ran wins ties, keeping it cache-warm
+        if (domain->finished || domain->claimed) continue;
+        uint64_t key = domain->curCycle | ((domain->prio? 1UL : 0UL) << 63);
+        if (key < bestKey) {
+            best = domain;
+            bestKey = key;
+        }
+    }
+    if (best && __sync_bool_compare_and_swap(&best->claimed, 0, 1)) {
+        simThreads[thid].lastDomain = best - domains;
+        return best;
+    }
+    return nullptr;
+}
+
+/* Work-stealing variant of simulatePhaseThread(). Threads repeatedly claim a
+ * domain and simulate up to STEAL_QUANTUM of its events, releasing it earlier
+ * if it stalls on a crossing, so a busy domain no longer leaves the threads
+ * that share its static range idle. A domain is simulated by one thread at a
+ * time and its events run in order, so the per-domain and crossing ordering
+ * guarantees are unchanged; only which thread runs each stretch varies.
+ */
+void ContentionSim::simulatePhaseStealing(uint32_t thid) {
+    SimThreadData& th = simThreads[thid];
+    uint64_t numEvents = 0;
+    uint32_t idleSpins = 0;
+    while (domainsDone < numDomains) {
+        DomainData* domain = claimDomain(thid);
+        if (!domain) {
+            //Nothing claimable; linear backoff as in futex_lock(), then give up the core to the threads doing work
+            if (idleSpins < STEAL_IDLE_SPINS) {
+                idleSpins++;
+                for (uint32_t j = 0; j < idleSpins; j++) _mm_pause();
+            } else {
+                sched_yield();
+            }
+            continue;
+        }
+        idleSpins = 0;
+        if (domain->finished) { //finished and released between our check and the claim
+            domain->claimed = 0;
+            continue;
+        }
+
+        th.profBusy.start();
+        domain->profTime.start();
+        uint32_t idx = domain - domains;
+        if (idx < th.firstDomain || idx >= th.supDomain) th.profSteals.inc();
+        if (domain->needsSplice) {
+            spliceSynced(*domain);
+            domain->needsSplice = false;
+        }
+
+        PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
+        for (uint32_t i = 0; i < STEAL_QUANTUM; i++) {
+            if (!pq.size() || pq.firstCycle() > limit) {
+                domain->curCycle = limit;
+                domain->finished = true;
+                __sync_fetch_and_add(&domainsDone, 1);
+                break;
+            }
+            uint64_t cycle;
+            TimingEvent* te = pq.dequeue(cycle);
+            if (cycle != domain->curCycle) domain->curCycle = cycle;
+            te->run(cycle);
+            numEvents++;
+            domain->curCycle = pq.size()? pq.firstCycle() : limit;
+            if (domain->prio) break; //stalled on a crossing, let other domains catch up
+        }
+
+        domain->profTime.end();
+        th.profBusy.end();
+        __sync_synchronize();
+        domain->claimed = 0;
+    }
+    th.profEvents.inc(numEvents);
+    __sync_synchronize();
+}
+
 void ContentionSim::finish() {
     assert(!terminate);
     terminate = true;
@@ -49,6 +49,12 @@ class CrossingEvent;
 
 #define PQ_BLOCKS 1024
 
+//With work stealing, events a thread simulates on a claimed domain before releasing it
+#define STEAL_QUANTUM 64
+
+//Failed claims a thread backs off for with growing _mm_pause() runs before it starts yielding its core
+#define STEAL_IDLE_SPINS 16
+
 class ContentionSim : public GlobAlloc {
     private:
         struct CompareEvents : public std::binary_function<TimingEvent*, TimingEvent*, bool> {
@@ -68,15 +74,27 @@ class ContentionSim : public GlobAlloc {
             PAD();
 
             volatile uint64_t curCycle;
-            lock_t pqLock; //used on phase 1 enqueues
+            //Phase 1 enqueues push here without locking (linked through TimingEvent::next, cycle in privCycle);
+            //the sim thread splices them into pq when the weave phase starts
+            TimingEvent* volatile syncedHead;
             //lock_t domainLock; //used by simulation thread
 
-            uint32_t prio;
+            volatile uint32_t prio;
             uint64_t queuePrio;
 
+            //Work stealing only; reset at the start of each phase
+            volatile uint32_t claimed; //1 while a sim thread is simulating this domain
+            volatile bool finished;
+            bool needsSplice;
+
             PAD();
 
             ClockStat profTime;
+            Counter profSyncedEnqueues;
+            Counter profSyncedRetries; //failed CASes on syncedHead, i.e., contended enqueues
+            Counter profMaxSplice;
+
+            slab::FreeBatch freeBatch; //frees of events run by this domain; only used while in the weave phase
 
 #if PROFILE_CROSSINGS
             VectorCounter profIncomingCrossingSims;
@@ -93,8 +111,13 @@ class ContentionSim : public GlobAlloc {
             lock_t wakeLock; //used to sleep/wake up simulation thread
             uint32_t firstDomain;
             uint32_t supDomain; //supreme, ie first not included
+            uint32_t lastDomain; //last domain claimed with work stealing, where the next scan starts
 
             std::vector<std::pair<uint64_t, TimingEvent*> > logVec;
+
+            ClockStat profBusy; //time spent simulating domains, excludes waiting for a claimable domain
+            Counter profEvents;
+            Counter profSteals; //claims of domains outside [firstDomain, supDomain)
         };
 
         //RO
@@ -106,6 +129,7 @@ class ContentionSim : public GlobAlloc {
         uint32_t numDomains;
         uint32_t numSimThreads;
         bool skipContention;
+        bool stealing; //if set, domains are claimed dynamically instead of statically split among threads
 
         PAD();
 
@@ -116,6 +140,7 @@ class ContentionSim : public GlobAlloc {
         volatile bool terminate;
 
         volatile uint32_t threadsDone;
+        volatile uint32_t domainsDone; //work stealing only
         volatile uint32_t threadTicket; //used only at init
 
         volatile bool inCSim; //true when inside contention simulation
@@ -125,8 +150,10 @@ class ContentionSim : public GlobAlloc {
         //lock_t testLock;
         lock_t postMortemLock;
 
+        ClockStat profPhaseTime;
+
     public:
-        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads);
+        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _stealing = false);
 
         void initStats(AggregateStat* parentStat);
 
@@ -151,6 +178,13 @@ class ContentionSim : public GlobAlloc {
 
         void setPrio(uint32_t domain, uint32_t prio) {domains[domain].prio = prio;}
 
+        //Null outside the weave phase (or for domain-less events); callers then free directly
+        slab::FreeBatch* getFreeBatch(int32_t domain) {
+            if (!inCSim || domain < 0) return nullptr;
+            assert(domain < (int32_t)numDomains);
+            return &domains[domain].freeBatch;
+        }
+
 #if PROFILE_CROSSINGS
         void profileCrossing(uint32_t srcDomain, uint32_t dstDomain, uint32_t count) {
             domains[dstDomain].profIncomingCrossings.inc(srcDomain);
@@ -160,8 +194,11 @@ class ContentionSim : public GlobAlloc {
 #endif
 
     private:
+        void spliceSynced(DomainData& domain);
         void simThreadLoop(uint32_t thid);
         void simulatePhaseThread(uint32_t thid);
+        void simulatePhaseStealing(uint32_t thid);
+        DomainData* claimDomain(uint32_t thid);
 
         static void SimThreadTrampoline(void* arg);
 };
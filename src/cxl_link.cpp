@@ -0,0 +1,183 @@
+#include "cxl_link.h"
+#include <algorithm>
+#include <cmath>
+#include "config.h"
+#include "event_recorder.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+// Recorder-allocated event, one per direction of a CXL transaction
+class CxlLinkEvent : public TimingEvent {
+    private:
+        CxlLink* link;
+        CxlLinkEvent* resp;     // requests only: the event of the matching response
+        uint64_t arrivalCycle;  // first arrival of the request at the link
+        uint32_t flits;
+        bool request;
+
+    public:
+        CxlLinkEvent(CxlLink* _link, bool _request, uint32_t _flits, int32_t domain)
+            : TimingEvent(0, 0, domain), link(_link), resp(nullptr), arrivalCycle(-1ul), flits(_flits), request(_request) {}
+
+        uint32_t getFlits() const {return flits;}
+        CxlLinkEvent* getResponse() const {return resp;}
+        void setResponse(CxlLinkEvent* _resp) {resp = _resp;}
+        uint64_t getArrivalCycle() const {return arrivalCycle;}
+        void setArrivalCycle(uint64_t cycle) {arrivalCycle = cycle;}
+
+        void simulate(uint64_t startCycle) {
+            if (request) link->requestArrived(this, startCycle);
+            else link->responseArrived(this, startCycle);
+        }
+};
+
+CxlLink::CxlLink(MemObject* _mem, uint32_t sysFreqMHz, uint32_t _domain, g_string& _name, Config& config, const char* cfgPrefix)
+    : mem(_mem), name(_name), domain(_domain)
+{
+    auto get = [&](const char* key, uint32_t def) {
+        return config.get<uint32_t>((std::string(cfgPrefix) + key).c_str(), def);
+    };
+    latency = get("latency", 50);
+    flitBytes = get("flitBytes", 68);
+    uint32_t bandwidth = get("bandwidth", 32000);  // MB/s per direction
+    credits = get("credits", 64);
+    queueDepth = get("queueDepth", 64);
+    retryLatency = get("retryLatency", 100);
+    if (!bandwidth || !credits || !flitBytes) panic("%s: bandwidth, credits and flitBytes must be non-zero", name.c_str());
+    cyclesPerFlit = (double)flitBytes * sysFreqMHz / bandwidth;
+
+    nextFreeCycle[DOWN] = nextFreeCycle[UP] = 0;
+    inflight = 0;
+
+    info("%s: CXL link to %s, %d cycles round trip, %.2f cycles/flit, %d credits, queue %d",
+            name.c_str(), mem->getName(), latency, cyclesPerFlit, credits, queueDepth);
+}
+
+void CxlLink::initStats(AggregateStat* parentStat) {
+    mem->initStats(parentStat);
+    AggregateStat* linkStats = new AggregateStat();
+    linkStats->init(name.c_str(), "CXL link stats");
+    profReads.init("rd", "Read requests"); linkStats->append(&profReads);
+    profWrites.init("wr", "Write requests"); linkStats->append(&profWrites);
+    profDownFlits.init("downFlits", "Flits sent to the device"); linkStats->append(&profDownFlits);
+    profUpFlits.init("upFlits", "Flits sent from the device"); linkStats->append(&profUpFlits);
+    profRetries.init("retries", "Requests retried on a full link queue"); linkStats->append(&profRetries);
+    profCreditStalls.init("creditStalls", "Requests that waited for a device credit"); linkStats->append(&profCreditStalls);
+    profQueueCycles.init("queueCycles", "Total cycles requests waited before transmission"); linkStats->append(&profQueueCycles);
+    profTotalLat.init("lat", "Total round-trip latency, including the device"); linkStats->append(&profTotalLat);
+    latencyHist.init(linkStats, "latHist", "Round-trip latency distribution");
+    parentStat->append(linkStats);
+}
+
+/* Bound phase interface */
+
+uint64_t CxlLink::getIdleLatency(Direction dir, uint32_t flits) const {
+    return getFlightLatency(dir) + (uint64_t)std::ceil(flits * cyclesPerFlit);
+}
+
+// Same chaining rules as DDRMemory::access(): 0 starts the record, 1 extends the
+// critical path, 2 starts an off-critical-path branch, 3 extends that branch
+void CxlLink::chainEvent(EventRecorder* evRec, MemReq& req, TimingEvent* ev, int type) {
+    if (type == 0) {
+        ev->setMinStartCycle(req.cycle);
+        TimingRecord tr = {req.lineAddr, req.cycle, req.cycle, req.type, ev, ev};
+        assert(!evRec->hasRecord());
+        evRec->pushRecord(tr);
+        return;
+    }
+    TimingRecord tr = evRec->popRecord();
+    ev->setMinStartCycle(tr.reqCycle);
+    TimingEvent* parent = (type == 3 && tr.bgEvent)? tr.bgEvent : tr.endEvent;
+    assert(parent);
+    parent->addChild(ev, evRec);
+    if (type == 1) tr.endEvent = ev;
+    else tr.bgEvent = ev;
+    evRec->pushRecord(tr);
+}
+
+// data_size is the number of 16B bursts, as in DDRMemory::access()
+uint64_t CxlLink::cxl_access(MemReq& req, int type, uint32_t data_size) {
+    if (req.type == PUTS) return mem->access(req, type, data_size);
+
+    bool isWrite = (req.type == PUTX);
+    uint32_t downFlits = getFlits(1 + (isWrite? data_size : 0));
+    uint32_t upFlits = getFlits(1 + (isWrite? 0 : data_size));
+    if (isWrite) profWrites.inc();
+    else profReads.inc();
+
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    CxlLinkEvent* reqEv = nullptr;
+    if (evRec) {
+        reqEv = new (evRec) CxlLinkEvent(this, true, downFlits, domain);
+        chainEvent(evRec, req, reqEv, type);
+    }
+
+    // The device access and the response follow the request on its (critical or background) path
+    int devType = (type == 0 || type == 1)? 1 : 3;
+    MemReq devReq = req;
+    devReq.cycle = req.cycle + getIdleLatency(DOWN, downFlits);
+    uint64_t respCycle = mem->access(devReq, devType, data_size) + getIdleLatency(UP, upFlits);
+
+    if (evRec) {
+        CxlLinkEvent* respEv = new (evRec) CxlLinkEvent(this, false, upFlits, domain);
+        chainEvent(evRec, req, respEv, devType);
+        reqEv->setResponse(respEv);
+        if (type == 0) {
+            TimingRecord tr = evRec->popRecord();
+            tr.respCycle = respCycle;
+            evRec->pushRecord(tr);
+        }
+    }
+    return respCycle;
+}
+
+/* Weave phase functionality */
+
+// Returns the cycle the last flit reaches the other end
+uint64_t CxlLink::transfer(Direction dir, uint32_t flits, uint64_t cycle) {
+    double start = std::max((double)cycle, nextFreeCycle[dir]);
+    nextFreeCycle[dir] = start + flits * cyclesPerFlit;
+    if (dir == DOWN) profDownFlits.inc(flits);
+    else profUpFlits.inc(flits);
+    return (uint64_t)std::ceil(nextFreeCycle[dir]) + getFlightLatency(dir);
+}
+
+void CxlLink::sendRequest(CxlLinkEvent* ev, uint64_t cycle) {
+    inflight++;
+    profQueueCycles.inc(cycle - ev->getArrivalCycle());
+    assert(ev->getResponse());
+    ev->getResponse()->setArrivalCycle(ev->getArrivalCycle());
+    ev->done(transfer(DOWN, ev->getFlits(), cycle));
+}
+
+void CxlLink::requestArrived(CxlLinkEvent* ev, uint64_t cycle) {
+    if (ev->getArrivalCycle() == -1ul) ev->setArrivalCycle(cycle);
+    if (inflight < credits) {
+        sendRequest(ev, cycle);
+    } else if (waitQueue.size() >= queueDepth) {
+        profRetries.inc();
+        ev->requeue(cycle + retryLatency);
+    } else {
+        profCreditStalls.inc();
+        ev->hold();
+        waitQueue.push_back(ev);
+    }
+}
+
+void CxlLink::responseArrived(CxlLinkEvent* ev, uint64_t cycle) {
+    uint64_t doneCycle = transfer(UP, ev->getFlits(), cycle);
+    uint64_t lat = doneCycle - ev->getArrivalCycle();
+    profTotalLat.inc(lat);
+    latencyHist.inc(lat);
+
+    // The device frees the request's credit once it sends the response
+    assert(inflight);
+    inflight--;
+    if (!waitQueue.empty()) {
+        CxlLinkEvent* next = waitQueue.front();
+        waitQueue.pop_front();
+        next->release();
+        sendRequest(next, cycle);
+    }
+    ev->done(doneCycle);
+}
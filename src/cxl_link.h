@@ -0,0 +1,86 @@
+#ifndef CXL_LINK_H_
+#define CXL_LINK_H_
+
+#include <deque>
+
+#include "g_std/g_string.h"
+#include "latency_hist.h"
+#include "memory_hierarchy.h"
+#include "pad.h"
+#include "stats.h"
+
+class Config;
+class CxlLinkEvent;
+class EventRecorder;
+class TimingEvent;
+
+/* CXL.mem link in front of a far memory. cxl_access() sends the request
+ * downstream, accesses the device and sends the response back upstream;
+ * access() goes to the device directly, bypassing the link.
+ *
+ * Each direction serializes whole flits at the link bandwidth. A flit holds 4
+ * 16B slots (one burst each), and every message spends one slot on its header.
+ * The device accepts at most `credits` outstanding requests; further requests
+ * wait in a FIFO of queueDepth entries, and are retried after retryLatency
+ * cycles when it is full. The bound phase assumes an idle link; queuing, credit
+ * stalls and retries are modeled in the weave phase.
+ */
+class CxlLink : public MemObject {
+    public:
+        enum Direction { DOWN = 0, UP = 1 };
+
+    private:
+        static const uint32_t SLOTS_PER_FLIT = 4;
+
+        MemObject* const mem;
+        const g_string name;
+        const uint32_t domain;
+        uint32_t latency;       // round trip, in sysCycles
+        uint32_t flitBytes;     // on the wire, including CRC
+        double cyclesPerFlit;   // per direction
+        uint32_t credits;
+        uint32_t queueDepth;
+        uint32_t retryLatency;
+
+        // Weave phase state
+        double nextFreeCycle[2];   // per direction, fractional sysCycles
+        uint32_t inflight;         // requests holding a device credit
+        std::deque<CxlLinkEvent*> waitQueue;  // requests waiting for a credit
+
+        // Stats
+        PAD();
+        Counter profReads, profWrites;
+        Counter profDownFlits, profUpFlits;
+        Counter profRetries, profCreditStalls;
+        Counter profQueueCycles;   // from arrival at the link to the start of transmission
+        Counter profTotalLat;      // from arrival at the link to the end of the response
+        LatencyHistogram latencyHist;
+        PAD();
+
+    public:
+        CxlLink(MemObject* _mem, uint32_t sysFreqMHz, uint32_t _domain, g_string& _name, Config& config, const char* cfgPrefix);
+
+        void initStats(AggregateStat* parentStat);
+        const char* getName() {return name.c_str();}
+
+        uint64_t access(MemReq& req) { return mem->access(req); }
+        uint64_t access(MemReq& req, int type, uint32_t data_size) { return mem->access(req, type, data_size); }
+        uint64_t cxl_access(MemReq& req, int type, uint32_t data_size);
+        uint64_t rd_dram_tag_latency(MemReq& req, uint32_t data_size) { return mem->rd_dram_tag_latency(req, data_size); }
+        uint64_t wt_dram_tag_latency(MemReq& req, uint32_t data_size) { return mem->wt_dram_tag_latency(req, data_size); }
+        void functionalAccess(Address lineAddr, bool isStore) { mem->functionalAccess(lineAddr, isStore); }
+
+        // Weave phase interface
+        void requestArrived(CxlLinkEvent* ev, uint64_t cycle);
+        void responseArrived(CxlLinkEvent* ev, uint64_t cycle);
+
+    private:
+        inline uint32_t getFlits(uint32_t slots) const { return (slots + SLOTS_PER_FLIT - 1) / SLOTS_PER_FLIT; }
+        inline uint32_t getFlightLatency(Direction dir) const { return (dir == DOWN)? latency / 2 : latency - latency / 2; }
+        uint64_t getIdleLatency(Direction dir, uint32_t flits) const;
+        uint64_t transfer(Direction dir, uint32_t flits, uint64_t cycle);
+        void sendRequest(CxlLinkEvent* ev, uint64_t cycle);
+        void chainEvent(EventRecorder* evRec, MemReq& req, TimingEvent* ev, int type);
+};
+
+#endif  // CXL_LINK_H_
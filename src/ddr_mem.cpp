@@ -44,20 +44,26 @@ class DDRMemoryAccEvent : public TimingEvent {
         DDRMemory* mem;
         Address addr;
 		uint32_t data_size;
+        uint32_t pendingChunks;  // reads: column-command streams not yet issued
+        uint32_t energyClass;
         bool write;
     public:
-        DDRMemoryAccEvent(DDRMemory* _mem, bool _isWrite, Address _addr, uint32_t _data_size, int32_t domain, uint32_t preDelay, uint32_t postDelay)
-            : TimingEvent(preDelay, postDelay, domain), mem(_mem), addr(_addr), data_size(_data_size), write(_isWrite) {}
+        DDRMemoryAccEvent(DDRMemory* _mem, bool _isWrite, Address _addr, uint32_t _data_size, uint32_t _energyClass, int32_t domain, uint32_t preDelay, uint32_t postDelay)
+            : TimingEvent(preDelay, postDelay, domain), mem(_mem), addr(_addr), data_size(_data_size), pendingChunks(0), energyClass(_energyClass), write(_isWrite) {}
 
         Address getAddr() const {return addr;}
         bool isWrite() const {return write;}
 		uint32_t getDataSize() const {return data_size;}
+        uint32_t getEnergyClass() const {return energyClass;}
+        void setPendingChunks(uint32_t chunks) {pendingChunks = chunks;}
+        // Returns true when the last chunk issues
+        bool chunkDone() {assert(pendingChunks); return --pendingChunks == 0;}
         void simulate(uint64_t startCycle) {
             mem->enqueue(this, startCycle);
         }
 };
 
-// Globally allocated event that calls us every tREFI cycles
+// Globally allocated event that calls us every tREFI cycles (every tREFI/units with per-bank refresh)
 class RefreshEvent : public TimingEvent, public GlobAlloc {
     private:
         DDRMemory* mem;
@@ -155,14 +161,22 @@ class SchedEvent : public TimingEvent, public GlobAlloc {
 DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerChannel, uint32_t _banksPerRank,
         uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, uint32_t _controllerSysLatency,
         uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage,
-        uint32_t _domain, g_string& _name, uint32_t _tBL, double time_scale)
+        uint32_t _domain, g_string& _name, uint32_t _tBL, double time_scale, uint32_t _rowSize, uint32_t _bankGroupsPerRank,
+        uint32_t _bulkPriority, bool _xorHash, uint32_t _refreshMode,
+        uint32_t _writeHighMark, uint32_t _writeLowMark, uint32_t _idleDrainMin, uint32_t _tRTW)
     : lineSize(_lineSize), ranksPerChannel(_ranksPerChannel), banksPerRank(_banksPerRank),
       controllerSysLatency(_controllerSysLatency), queueDepth(_queueDepth), rowHitLimit(_rowHitLimit),
-      deferredWrites(_deferredWrites), closedPage(_closedPage), domain(_domain), name(_name)
+      deferredWrites(_deferredWrites), closedPage(_closedPage), bulkPriority(_bulkPriority), xorHash(_xorHash), refreshMode(_refreshMode),
+      writeHighMark((_writeHighMark == -1u)? 3*_queueDepth/4 : _writeHighMark),
+      writeLowMark((_writeLowMark == -1u)? _queueDepth/4 : _writeLowMark),
+      idleDrainMin(_idleDrainMin), domain(_domain), name(_name)
 {
     sysFreqKHz = 1000 * _sysFreqMHz;
-    initTech(tech, time_scale);  // sets all tXX and memFreqKHz
+    initTech(tech, time_scale);  // sets all tXX, memFreqKHz and the bank groups
 	tBL = _tBL;
+    if (_tRTW != -1u) tRTW = uint32_t(_tRTW / time_scale);
+    if (_bankGroupsPerRank) bankGroupsPerRank = _bankGroupsPerRank;
+    if (banksPerRank % bankGroupsPerRank) panic("%s: %d banks/rank not divisible into %d bank groups", name.c_str(), banksPerRank, bankGroupsPerRank);
     if (memFreqKHz >= sysFreqKHz/2) {
         panic("You may need to tweak the scheduling code, which works with system cycles." \
             "With these frequencies, events (which run on system cycles) can't hit us every memory cycle.");
@@ -177,22 +191,45 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
 
     rdQueue.init(queueDepth);
     wrQueue.init(queueDepth);
+    nextSeq = 0;
+    if (writeLowMark > writeHighMark || writeHighMark > queueDepth) {
+        panic("%s: invalid write watermarks %d/%d for queue depth %d", name.c_str(), writeLowMark, writeHighMark, queueDepth);
+    }
+    lastCmdWasWrite = false;
 
-    info("%s: domain %d, %d ranks/ch %d banks/rank, tech %s, boundLat %d rd / %d wr",
-            name.c_str(), domain, ranksPerChannel, banksPerRank, tech, minRdLatency, minWrLatency);
+    info("%s: domain %d, %d ranks/ch %d banks/rank in %d groups, tech %s, boundLat %d rd / %d wr",
+            name.c_str(), domain, ranksPerChannel, banksPerRank, bankGroupsPerRank, tech, minRdLatency, minWrLatency);
 
     minRespCycle = tCL + tBL + 1; // We subtract tCL + tBL from this on some checks; this avoids overflows
+    lastCmdRank = lastCmdGroup = 0;
 
     banks.resize(ranksPerChannel);
     for (uint32_t i = 0; i < ranksPerChannel; i++) banks[i].resize(banksPerRank);
 
+    for (SchedIndex* index : {&rdIndex, &wrIndex}) {
+        index->pending.init(ranksPerChannel * banksPerRank);
+        index->ready.init(ranksPerChannel * banksPerRank);
+    }
+
     rankActWindows.resize(ranksPerChannel);
     for (uint32_t i = 0; i < ranksPerChannel; i++) rankActWindows[i].init(4);  // we only model FAW; for TAW (other technologies) change this to 2
 
-    // We get line addresses, and for a 64-byte line, there are _colSize/(JEDEC_BUS_WIDTH/8) lines/page
-    uint32_t colBits = ilog2(_colSize/(JEDEC_BUS_WIDTH/8)*64/lineSize);
-    uint32_t bankBits = ilog2(banksPerRank);
-    uint32_t rankBits = ilog2(ranksPerChannel);
+    rankLastActCycle.resize(ranksPerChannel, 0);
+    rankLastColCycle.resize(ranksPerChannel, 0);
+    groupLastActCycle.resize(ranksPerChannel);
+    groupLastColCycle.resize(ranksPerChannel);
+    for (uint32_t i = 0; i < ranksPerChannel; i++) {
+        groupLastActCycle[i].resize(bankGroupsPerRank, 0);
+        groupLastColCycle[i].resize(bankGroupsPerRank, 0);
+    }
+
+    // We get line addresses, and for a 64-byte line, there are _colSize/(JEDEC_BUS_WIDTH/8) lines/page,
+    // unless the row size is given (or implied by the technology) in bytes
+    uint32_t rowSize = _rowSize? _rowSize : techRowSize;
+    if (rowSize && (!isPow2(rowSize) || rowSize < lineSize)) panic("%s: invalid row size %d", name.c_str(), rowSize);
+    uint32_t colBits = rowSize? ilog2(rowSize/lineSize) : ilog2(_colSize/(JEDEC_BUS_WIDTH/8)*64/lineSize);
+    bankBits = ilog2(banksPerRank);
+    rankBits = ilog2(ranksPerChannel);
 
     // Parse config string, has to be some combination of rank, bank, and col separated by semicolons
     // (row is always MSB bits, since we don't actually know how many bits it is to begin with...)
@@ -217,12 +254,23 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
     }
     rowShift = startBit;  // row has no mask
 
-    info("%s: Address mapping %s row %d:%ld col %d:%d rank %d:%d bank %d:%d",
+    info("%s: Address mapping %s row %d:%ld col %d:%d rank %d:%d bank %d:%d%s",
             name.c_str(), addrMapping, 63, rowShift, ilog2(colMask << colShift), colShift,
-            ilog2(rankMask << rankShift), rankShift, ilog2(bankMask << bankShift), bankShift);
+            ilog2(rankMask << rankShift), rankShift, ilog2(bankMask << bankShift), bankShift,
+            xorHash? ", XOR-hashed bank/rank" : "");
+
+    // Refresh rounds, see refreshBanks()
+    if (refreshMode == REFRESH_PER_BANK) refreshUnits = banksPerRank;
+    else if (refreshMode == REFRESH_SAME_BANK) refreshUnits = banksPerRank / bankGroupsPerRank;
+    else refreshUnits = 1;
+    if (refreshMode == REFRESH_SAME_BANK && bankGroupsPerRank == 1) panic("%s: same-bank refresh needs bank groups", name.c_str());
+    if (refreshUnits > 64) panic("%s: %d refresh units per rank, max 64", name.c_str(), refreshUnits);
+    nextRefreshUnit.resize(ranksPerChannel, 0);
+    refreshedUnits.resize(ranksPerChannel, 0);
+    rankActiveEnd.resize(ranksPerChannel, 0);
 
     // Weave phase events
-    new RefreshEvent(this, memToSysCycle(tREFI), domain);
+    new RefreshEvent(this, memToSysCycle(tREFI / refreshUnits), domain);
 
     nextSchedCycle = -1ul;
     nextSchedEvent = nullptr;
@@ -240,8 +288,39 @@ void DDRMemory::initStats(AggregateStat* parentStat) {
     profTotalWrLat.init("wrlat", "Total latency experienced by write requests"); memStats->append(&profTotalWrLat);
     profReadHits.init("rdhits", "Read row hits"); memStats->append(&profReadHits);
     profWriteHits.init("wrhits", "Write row hits"); memStats->append(&profWriteHits);
-    latencyHist.init("mlh", "latency histogram for memory requests", NUMBINS); 
-	// XXX //memStats->append(&latencyHist);
+    profBulkReads.init("bulkRd", "Bulk (multi-line) read requests"); memStats->append(&profBulkReads);
+    profBulkWrites.init("bulkWr", "Bulk (multi-line) write requests"); memStats->append(&profBulkWrites);
+    profBulkChunks.init("bulkChunks", "Per-row column-command streams of bulk requests"); memStats->append(&profBulkChunks);
+    bankAccesses.init("bankAcc", "RD/WR commands per bank", ranksPerChannel * banksPerRank); memStats->append(&bankAccesses);
+    profRefreshes.init("refreshes", "REF commands"); memStats->append(&profRefreshes);
+    profRefreshStalls.init("refStalls", "RD/WR commands delayed by a refresh of their bank"); memStats->append(&profRefreshStalls);
+    profRefreshStallCycles.init("refStallCycles", "Total memory cycles RD/WR commands waited on refreshes"); memStats->append(&profRefreshStallCycles);
+    profRdToWr.init("rdToWr", "Read to write data bus turnarounds"); memStats->append(&profRdToWr);
+    profWrToRd.init("wrToRd", "Write to read data bus turnarounds"); memStats->append(&profWrToRd);
+    profTurnaroundCycles.init("turnCycles", "Memory cycles RD/WR commands waited on bus turnarounds"); memStats->append(&profTurnaroundCycles);
+    profDrainsHigh.init("drainsHigh", "Write drains started above the high watermark"); memStats->append(&profDrainsHigh);
+    profDrainsIdle.init("drainsIdle", "Write drains started with no reads queued"); memStats->append(&profDrainsIdle);
+    profDrainWrites.init("drainWrites", "Writes issued during write drains"); memStats->append(&profDrainWrites);
+
+    AggregateStat* energyStats = new AggregateStat();
+    energyStats->init("energy", "IDD-based energy, in pJ");
+    profActEnergy.init("act", "ACT/PRE energy"); energyStats->append(&profActEnergy);
+    profRdEnergy.init("rd", "RD burst energy"); energyStats->append(&profRdEnergy);
+    profWrEnergy.init("wr", "WR burst energy"); energyStats->append(&profWrEnergy);
+    profRefEnergy.init("ref", "Refresh energy"); energyStats->append(&profRefEnergy);
+    auto bgEnergy = makeLambdaStat([this]() { return getBackgroundEnergy(); });
+    bgEnergy->init("bg", "Background (standby) energy"); energyStats->append(bgEnergy);
+    auto totalEnergy = makeLambdaStat([this]() {
+        return profActEnergy.get() + profRdEnergy.get() + profWrEnergy.get() + getStaticEnergy();
+    });
+    totalEnergy->init("total", "Total energy"); energyStats->append(totalEnergy);
+    profClassEnergy.init("class", "ACT/PRE and RD/WR energy by access class (demand, metadata, migration)", ENERGY_CLASSES);
+    energyStats->append(&profClassEnergy);
+    profActiveCycles.init("activeCycles", "Rank-cycles with a row open (active standby)"); energyStats->append(&profActiveCycles);
+    memStats->append(energyStats);
+    auto bankImbalance = makeLambdaStat([this]() { return vectorImbalance(bankAccesses); });
+    bankImbalance->init("bankImbalance", "Max over mean RD/WR commands per bank, x1000"); memStats->append(bankImbalance);
+    rdLatHist.init(memStats, "rdlatHist", "Read latency distribution");
     parentStat->append(memStats);
 }
 
@@ -270,13 +349,19 @@ uint64_t DDRMemory::access(MemReq& req, int type, uint32_t data_size) {
 		// TODO If length > 1 cacheline, add 4 cycle for each cacheline
         uint64_t respCycle;
         if(data_size == 0)respCycle = req.cycle;
-        else respCycle = req.cycle + (isWrite? minWrLatency : minRdLatency) + memToSysCycle(data_size - 1);
+        else respCycle = req.cycle + (isWrite? minWrLatency : minRdLatency) + memToSysCycle(data_size * burstCycles - 1);
         if (zinfo->eventRecorders[req.srcId]) {
 			// accessing multiple lines is modeled as multiple requests.
 			// All the requests can be processed in parallel.
 			//  
+            uint32_t energyClass;
+            if (req.is(MemReq::DRAM_METADATA)) energyClass = ENERGY_METADATA;
+            else if (req.is(MemReq::DRAM_MIGRATION)) energyClass = ENERGY_MIGRATION;
+            else if (req.is(MemReq::DRAM_DEMAND)) energyClass = ENERGY_DEMAND;
+            // Callers that set no class (e.g., main memory without a DRAM cache): guess from the access
+            else energyClass = (data_size < lineSize / 16)? ENERGY_METADATA : (type >= 2)? ENERGY_MIGRATION : ENERGY_DEMAND;
             DDRMemoryAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) DDRMemoryAccEvent(this,
-                    isWrite, req.lineAddr, data_size, domain, preDelay, isWrite? postDelayWr : postDelayRd);
+                    isWrite, req.lineAddr, data_size, energyClass, domain, preDelay, isWrite? postDelayWr : postDelayRd);
 			if (type == 0) // default. The only record. 
             {
             	memEv->setMinStartCycle(req.cycle);
@@ -302,6 +387,17 @@ uint64_t DDRMemory::access(MemReq& req, int type, uint32_t data_size) {
 				tr.endEvent->addChild(memEv, zinfo->eventRecorders[req.srcId]);
 				//tr.respCycle = respCycle;
 				tr.type = req.type;
+				tr.bgEvent = memEv;
+           	 	zinfo->eventRecorders[req.srcId]->pushRecord(tr);
+			} else if (type == 3) {
+				// append the current event to the end of the previous off-critical-path
+				// event (e.g., a writeback that must wait for its fast-memory read)
+           	 	TimingRecord tr = zinfo->eventRecorders[req.srcId]->popRecord();
+            	memEv->setMinStartCycle(tr.reqCycle);
+				TimingEvent* parent = tr.bgEvent? tr.bgEvent : tr.endEvent;
+				assert(parent);
+				parent->addChild(memEv, zinfo->eventRecorders[req.srcId]);
+				tr.bgEvent = memEv;
            	 	zinfo->eventRecorders[req.srcId]->pushRecord(tr);
 			}
         }
@@ -311,11 +407,6 @@ uint64_t DDRMemory::access(MemReq& req, int type, uint32_t data_size) {
 }
 
 
-uint64_t DDRMemory::cxl_access(MemReq& req, int type, uint32_t data_size)
-{
-    return access(req,type,data_size)+50;
-}
-
 uint64_t
 DDRMemory::rd_dram_tag_latency(MemReq& req, uint32_t data_size)
 {
@@ -341,6 +432,14 @@ DDRMemory::AddrLoc DDRMemory::mapLineAddr(Address lineAddr) {
     l.rank = (lineAddr >> rankShift) & rankMask;
     l.bank = (lineAddr >> bankShift) & bankMask;
     l.row  = lineAddr >> rowShift;
+    if (xorHash) {
+        // Permutation-based interleaving: XOR the bank and rank with the folded
+        // row, so rows that conflict in one bank spread out. Lines of a row stay
+        // in the same bank, which keeps row buffer locality.
+        uint64_t fold = xorFold(l.row, bankBits + rankBits);
+        l.bank ^= fold & bankMask;
+        l.rank ^= (fold >> bankBits) & rankMask;
+    }
 
     //info("0x%lx r%ld:c%d b%d:r%d", lineAddr, l.row, l.col, l.bank, l.rank);
     assert(l.rank < ranksPerChannel);
@@ -351,57 +450,104 @@ DDRMemory::AddrLoc DDRMemory::mapLineAddr(Address lineAddr) {
 
 void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     uint64_t memCycle = sysToMemCycle(sysCycle);
-    DEBUG("%ld: enqueue() addr 0x%lx wr %d", memCycle, ev->getAddr(), ev->isWrite());
+    DEBUG("%ld: enqueue() addr 0x%lx wr %d size %d", memCycle, ev->getAddr(), ev->isWrite(), ev->getDataSize());
+    ev->hold();
 
-    // Create request
-    Request ovfReq;
-    bool overflow = rdQueue.full() || wrQueue.full();
-    bool useWrQueue = deferredWrites && ev->isWrite();
-    Request* req = overflow? &ovfReq : useWrQueue? wrQueue.alloc() : rdQueue.alloc();
+    Request req;
+    req.write = ev->isWrite();
+    req.arrivalCycle = memCycle;
+    req.startSysCycle = sysCycle;
+    req.ev = ev;
+    req.energyClass = ev->getEnergyClass();
+
+    uint32_t lineBursts = lineSize / 16;
+    if (ev->getDataSize() <= lineBursts) {
+        req.addr = ev->getAddr();
+        req.loc = mapLineAddr(ev->getAddr());
+        req.data_size = ev->getDataSize();
+        req.bulk = false;
+        req.chunk = 0;
+        ev->setPendingChunks(1);
+        enqueueRequest(req, memCycle, sysCycle);
+        return;
+    }
 
-    req->addr = ev->getAddr();
-    req->loc = mapLineAddr(ev->getAddr());
-	req->data_size = ev->getDataSize();
-    req->write = ev->isWrite();
-    req->arrivalCycle = memCycle;
-    req->startSysCycle = sysCycle;
+    /* Bulk transfer (e.g., a page fill or migration). The lines of a row are
+     * read or written back to back with column commands, so each row the
+     * transfer touches becomes one request, scheduled with the demand traffic
+     * of its bank. Reads complete when their last chunk issues; writes respond
+     * once, when the first chunk is queued.
+     */
+    bulkChunks.clear();
+    for (uint32_t i = 0, bursts = 0; bursts < ev->getDataSize(); i++, bursts += lineBursts) {
+        Address lineAddr = ev->getAddr() + i;
+        AddrLoc loc = mapLineAddr(lineAddr);
+        uint32_t size = std::min(lineBursts, ev->getDataSize() - bursts);
+
+        Request* chunk = nullptr;
+        for (auto it = bulkChunks.rbegin(); it != bulkChunks.rend(); it++) {
+            if (it->loc.rank == loc.rank && it->loc.bank == loc.bank && it->loc.row == loc.row) {
+                chunk = &*it;
+                break;
+            }
+        }
+        if (chunk) {
+            chunk->data_size += size;
+        } else {
+            req.addr = lineAddr;
+            req.loc = loc;
+            req.data_size = size;
+            req.bulk = true;
+            req.chunk = bulkChunks.size();
+            if (req.write && req.chunk) req.ev = nullptr;
+            bulkChunks.push_back(req);
+        }
+    }
 
-    req->ev = ev;
-    ev->hold();
+    ev->setPendingChunks(req.write? 1 : bulkChunks.size());
+    profBulkChunks.inc(bulkChunks.size());
+    for (const Request& chunk : bulkChunks) enqueueRequest(chunk, memCycle, sysCycle);
+}
 
+void DDRMemory::enqueueRequest(const Request& r, uint64_t memCycle, uint64_t sysCycle) {
+    bool overflow = rdQueue.full() || wrQueue.full();
     if (overflow) {
-        overflowQueue.push_back(*req);
-    } else {
-        queue(req, memCycle);
-
-        // If needed, schedule an event to handle this new request
-        if (!req->prev /* first in bank */) {
-			// XXX I don't know what this code is doing, but just adding data_size anyway.
-            uint64_t minSchedCycle = std::max(memCycle, minRespCycle - tCL - tBL); // * req->data_size);
-            if (nextSchedCycle > minSchedCycle) minSchedCycle = std::max(minSchedCycle, findMinCmdCycle(*req));
-            if (nextSchedCycle > minSchedCycle) {
-                if (nextSchedEvent) nextSchedEvent->annul();
-                if (eventFreelist) {
-                    nextSchedEvent = eventFreelist;
-                    eventFreelist = eventFreelist->next;
-                    nextSchedEvent->next = nullptr;
-                } else {
-                    nextSchedEvent = new SchedEvent(this, domain);
-                }
-                DEBUG("queued %ld", minSchedCycle);
+        overflowQueue.push_back(r);
+        return;
+    }
 
-                // Under memFreq < sysFreq/2, sysToMemCycle translates back to the same memCycle
-                uint64_t enqSysCycle = std::max(matchingMemToSysCycle(minSchedCycle), sysCycle);
-                nextSchedEvent->enqueue(enqSysCycle);
-                nextSchedCycle = minSchedCycle;
+    bool useWrQueue = deferredWrites && r.write;
+    Request* req = useWrQueue? wrQueue.alloc() : rdQueue.alloc();
+    *req = r;
+    queue(req, memCycle);
+
+    // If needed, schedule an event to handle this new request (or to retry writes held back from an idle drain)
+    if (!req->prev /* first in bank */ || nextSchedCycle == -1ul) {
+		// XXX I don't know what this code is doing, but just adding data_size anyway.
+        uint64_t minSchedCycle = std::max(memCycle, minRespCycle - tCL - tBL); // * req->data_size);
+        if (nextSchedCycle > minSchedCycle) minSchedCycle = std::max(minSchedCycle, findMinCmdCycle(*req));
+        if (nextSchedCycle > minSchedCycle) {
+            if (nextSchedEvent) nextSchedEvent->annul();
+            if (eventFreelist) {
+                nextSchedEvent = eventFreelist;
+                eventFreelist = eventFreelist->next;
+                nextSchedEvent->next = nullptr;
+            } else {
+                nextSchedEvent = new SchedEvent(this, domain);
             }
+            DEBUG("queued %ld", minSchedCycle);
+
+            // Under memFreq < sysFreq/2, sysToMemCycle translates back to the same memCycle
+            uint64_t enqSysCycle = std::max(matchingMemToSysCycle(minSchedCycle), sysCycle);
+            nextSchedEvent->enqueue(enqSysCycle);
+            nextSchedCycle = minSchedCycle;
         }
     }
 }
 
 void DDRMemory::queue(Request* req, uint64_t memCycle) {
-    // If it's a write, respond to it immediately
-    if (req->write) {
+    // If it's a write, respond to it immediately (bulk writes, on their first chunk)
+    if (req->write && req->ev) {
         auto ev = req->ev;
         req->ev = nullptr;
 
@@ -411,6 +557,7 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
     }
 
     req->arrivalCycle = memCycle;  // if this comes from the overflow queue, update
+    req->seq = nextSeq++;
 
     // Test: Skip writes
 #if 0
@@ -469,14 +616,30 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
              req->rowHitSeq = bank.curRowHits + 1;
             q.push_front(req);
         } else {
-            // ... and row is closed or has too many hits, maintain FCFS
+            // ... and row is closed or has too many hits, maintain FCFS within its priority class
             req->rowHitSeq = 0;
-            q.push_back(req);
+            Request* prev = q.back();
+            if (!isLowPrio(*req)) {
+                // Go ahead of demoted requests, but never before the head (see NOTE above)
+                while (prev && prev->prev && isLowPrio(*prev)) prev = prev->prev;
+            }
+            if (prev == q.back()) q.push_back(req);
+            else q.insertAfter(prev, req);
         }
     }
 #if 0
     printQ("POST");
 #endif
+
+    if (!req->prev) resetBankIndex(req->loc.rank * banksPerRank + req->loc.bank, deferredWrites && req->write);
+}
+
+// The head request of bank b changed: its ready cycle is unknown again
+void DDRMemory::resetBankIndex(uint32_t b, bool write) {
+    SchedIndex& index = write? wrIndex : rdIndex;
+    if (index.pending.contains(b)) index.pending.remove(b);
+    if (index.ready.contains(b)) index.ready.remove(b);
+    if (!getBankQueue(b, write).empty()) index.pending.update(b, 0);
 }
 
 // For external ticks
@@ -526,7 +689,9 @@ void DDRMemory::recycleEvent(SchedEvent* ev) {
 
 uint64_t DDRMemory::findMinCmdCycle(const Request& r) const {
     const Bank& bank = banks[r.loc.rank][r.loc.bank];
+    uint32_t group = getBankGroup(r.loc.bank);
     uint64_t minCmdCycle = std::max(r.arrivalCycle, bank.lastCmdCycle + 1);
+    minCmdCycle = std::max(minCmdCycle, std::max(groupLastColCycle[r.loc.rank][group] + tCCD_L, rankLastColCycle[r.loc.rank] + tCCD_S));
     if (r.loc.row == bank.openRow && bank.open) {
         // Row buffer hit
     } else {
@@ -539,12 +704,31 @@ uint64_t DDRMemory::findMinCmdCycle(const Request& r) const {
             preCycle = std::max(r.arrivalCycle, bank.minPreCycle);
         }
         uint64_t actCycle = std::max(r.arrivalCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
+        actCycle = std::max(actCycle, std::max(groupLastActCycle[r.loc.rank][group] + tRRD_L, rankLastActCycle[r.loc.rank] + tRRD_S));
         actCycle = std::max(actCycle, rankActWindows[r.loc.rank].minActCycle() + tFAW);
-        minCmdCycle = actCycle + tRCD;
+        minCmdCycle = std::max(minCmdCycle, actCycle + tRCD);
     }
     return minCmdCycle;
 }
 
+// The request trySchedule() must pick, found by scanning all bank heads; checks the index in debug builds
+DDRMemory::Request* DDRMemory::linearSchedule(bool isWriteQueue, uint64_t curCycle) {
+    Request* r = nullptr;
+    bool rOtherGroup = false;
+    for (uint32_t b = 0; b < ranksPerChannel * banksPerRank; b++) {
+        InList<Request>& q = getBankQueue(b, isWriteQueue);
+        if (q.empty()) continue;
+        Request* head = q.front();
+        if (findMinCmdCycle(*head) > curCycle) continue;
+        bool otherGroup = bankGroupsPerRank > 1 && (head->loc.rank != lastCmdRank || getBankGroup(head->loc.bank) != lastCmdGroup);
+        if (!r || (otherGroup && !rOtherGroup) || (otherGroup == rOtherGroup && getSchedKey(*head) < getSchedKey(*r))) {
+            r = head;
+            rOtherGroup = otherGroup;
+        }
+    }
+    return r;
+}
+
 // 根据内存的读写队列情况 决定响应读还是写
 uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     /* Implement FR-FCFS scheduling to maximize bus utilization
@@ -564,38 +748,54 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     if (rdQueue.empty() && wrQueue.empty()) return -1ul;
     if (curCycle + tCL < minRespCycle) return minRespCycle - tCL;  // too far ahead
 
-    // Writes have priority if the write queue is getting full...
-    bool prioWrites = (wrQueue.size() > (3*queueDepth/4)) || (lastCmdWasWrite && wrQueue.size() > queueDepth/4);
+    // Writes have priority if the write queue is getting full, until it drops to the low watermark...
+    bool prioWrites = (wrQueue.size() > writeHighMark) || (lastCmdWasWrite && wrQueue.size() > writeLowMark);
     bool isWriteQueue = rdQueue.empty() || prioWrites;
+    // ... and otherwise are drained only when there are no reads, and enough writes to amortize the turnarounds
+    if (!prioWrites && rdQueue.empty() && !lastCmdWasWrite && wrQueue.size() < idleDrainMin) return -1ul;
 
     RequestQueue<Request>& queue = isWriteQueue? wrQueue : rdQueue;
     assert(!queue.empty());
 
+    // Oldest ready request, but with bank groups, prefer the oldest ready one in another
+    // group than the last RD/WR, so the next column command only pays tCCD_S.
+    // Banks whose bound has passed are tried in age order; those still not ready go
+    // back to pending with their exact ready cycle.
+    SchedIndex& index = isWriteQueue? wrIndex : rdIndex;
+    while (!index.pending.empty() && index.pending.topKey() <= curCycle) {
+        uint32_t b = index.pending.pop();
+        index.ready.update(b, getSchedKey(*getBankQueue(b, isWriteQueue).front()));
+    }
+
     Request* r = nullptr;
-    RequestQueue<Request>::iterator ir = queue.begin();
     uint64_t minSchedCycle = -1ul;
-    while (ir != queue.end()) {
-        //Bank& bank = banks[(*ir)->loc.rank][(*ir)->loc.bank];
-        //if ((isWriteQueue? bank.wrReqs : bank.rdReqs).front() == *ir) {
-        if (!(*ir)->prev) {  // FASTAH!
-            uint64_t minCmdCycle = findMinCmdCycle(**ir);
+    while (!index.ready.empty()) {
+        uint32_t b = index.ready.pop();
+        Request* head = getBankQueue(b, isWriteQueue).front();
+        uint64_t minCmdCycle = findMinCmdCycle(*head);
+        if (minCmdCycle > curCycle) {
+            index.pending.update(b, minCmdCycle);
             minSchedCycle = std::min(minSchedCycle, minCmdCycle);
-            if (minCmdCycle <= curCycle) {
-                r = *ir;
-                break;
-            }
-            //DEBUG("Skipping 0x%lx, not ready %ld", (*ir)->ev->getAddr(), minCmdCycle);
+            continue;
+        }
+        bool otherGroup = head->loc.rank != lastCmdRank || getBankGroup(head->loc.bank) != lastCmdGroup;
+        if (!r || otherGroup) {
+            if (r) schedStash.push_back(r->loc.rank * banksPerRank + r->loc.bank);
+            r = head;
         } else {
-            //DEBUG("Skipping 0x%lx, not first", (*ir)->ev->getAddr());
+            schedStash.push_back(b);
         }
-		//printf("ir=%ld\n", (uint64_t)&ir);
-        ir.inc();
+        if (bankGroupsPerRank == 1 || otherGroup) break;
     }
+    for (uint32_t b : schedStash) index.ready.update(b, getSchedKey(*getBankQueue(b, isWriteQueue).front()));
+    schedStash.clear();
+    assert_msg(r == linearSchedule(isWriteQueue, curCycle), "%s: scheduling index and linear scan disagree at %ld", name.c_str(), curCycle);
     if (!r) {
         /* Because we have an event-driven model that uses the same timing
          * constraints to schedule a tick, this rarely happens. For example,
          * refreshes trigger these.
          */
+        if (!index.pending.empty()) minSchedCycle = std::min(minSchedCycle, index.pending.topKey());
         DEBUG("%ld : First req ready at %ld", curCycle, minSchedCycle);
         return minSchedCycle;  // no requests are ready to issue yet
     }
@@ -603,11 +803,16 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     DEBUG("%ld : Found ready request 0x%lx %s %ld (%ld / %ld)", curCycle, r->addr, r->write? "W" : "R", r->arrivalCycle, rdQueue.size(), wrQueue.size());
     // std::cout << curCycle << " Found ready request 0x" <<  r->addr << "   r->arrCycle= " << r->arrivalCycle << std::endl;
     Bank& bank = banks[r->loc.rank][r->loc.bank];
+    uint32_t group = getBankGroup(r->loc.bank);
 
     // Compute the minimum cycle at which the read or write command can be issued,
     // without column access or data bus constraints
     uint64_t minCmdCycle = std::max(curCycle, minRespCycle - tCL);
-    if (lastCmdWasWrite && !r->write) minCmdCycle = std::max(minCmdCycle, minRespCycle + tWTR);
+    minCmdCycle = std::max(minCmdCycle, std::max(groupLastColCycle[r->loc.rank][group] + tCCD_L, rankLastColCycle[r->loc.rank] + tCCD_S));
+    // Data bus turnarounds: a RD waits tWTR after the last WR burst, and a WR leaves tRTW idle cycles after a RD burst
+    uint64_t turnCycle = 0;
+    if (lastCmdWasWrite && !r->write) turnCycle = minRespCycle + tWTR;
+    else if (!lastCmdWasWrite && r->write) turnCycle = minRespCycle - tCL + tRTW;
     bool rowHit = false;
     if (r->loc.row == bank.openRow && bank.open) {
         // Row buffer hit
@@ -624,25 +829,48 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         }
 
         uint64_t actCycle = std::max(r->arrivalCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
+        actCycle = std::max(actCycle, std::max(groupLastActCycle[r->loc.rank][group] + tRRD_L, rankLastActCycle[r->loc.rank] + tRRD_S));
         actCycle = std::max(actCycle, rankActWindows[r->loc.rank].minActCycle() + tFAW);
 
-        // Record ACT
+        // Record ACT (and the PRE that closed the previous row, if any)
+        if (preIssued) addActiveInterval(r->loc.rank, bank.lastActCycle, preCycle);
+        uint64_t actEnergy = std::round(eActPre);
+        profActEnergy.inc(actEnergy);
+        profClassEnergy.inc(r->energyClass, actEnergy);
         bank.open = true;
         bank.openRow = r->loc.row;
         if (preIssued) bank.minPreCycle = preCycle + tRAS;
         rankActWindows[r->loc.rank].addActivation(actCycle);
         bank.lastActCycle = actCycle;
+        groupLastActCycle[r->loc.rank][group] = std::max(groupLastActCycle[r->loc.rank][group], actCycle);
+        rankLastActCycle[r->loc.rank] = std::max(rankLastActCycle[r->loc.rank], actCycle);
 
         minCmdCycle = std::max(minCmdCycle, actCycle + tRCD);
     }
 
     // Figure out data bus constraints, find actual time at which command is issued
     uint64_t cmdCycle = std::max(minCmdCycle, minRespCycle - tCL);
+    if (turnCycle > cmdCycle) {
+        profTurnaroundCycles.inc(turnCycle - cmdCycle);
+        cmdCycle = turnCycle;
+    }
+    if (r->write != lastCmdWasWrite) {
+        if (r->write) {
+            profRdToWr.inc();
+            // Only deferred writes drain; with a shared queue, writes just issue in FR-FCFS order
+            if (isWriteQueue && deferredWrites) (prioWrites? profDrainsHigh : profDrainsIdle).inc();
+        } else {
+            profWrToRd.inc();
+        }
+    }
+    if (r->write && isWriteQueue && deferredWrites) profDrainWrites.inc();
 	// To support accessing granularity greater than a cacheline. 
     //minRespCycle = cmdCycle + tCL + tBL;
     //minRespCycle = cmdCycle + tCL + tBL * r->data_size;
-    minRespCycle = cmdCycle + tCL + r->data_size;
+    minRespCycle = cmdCycle + tCL + r->data_size * burstCycles;
     lastCmdWasWrite = r->write;
+    lastCmdRank = r->loc.rank;
+    lastCmdGroup = group;
 
     // Record PRE
     // if closed-page, close (auto-precharge) if no more row buffer hits
@@ -653,11 +881,27 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
             std::max(bank.lastActCycle + tRAS,  // RAS constraint
             r->write? minRespCycle + tWR : cmdCycle + tRTP  // read to precharge for reads, write recovery for writes
             ));
+    if (!bank.open) addActiveInterval(r->loc.rank, bank.lastActCycle, bank.minPreCycle);
+
+    // Both queues share the banks: an ACT or auto-precharge changes which heads of the
+    // other queue are row hits, and can make them ready before their indexed bound
+    if (deferredWrites && (!rowHit || !bank.open)) resetBankIndex(r->loc.rank * banksPerRank + r->loc.bank, !isWriteQueue);
 
     // Record RD or WR
     assert(bank.lastCmdCycle < cmdCycle);
     bank.lastCmdCycle = cmdCycle;
+    groupLastColCycle[r->loc.rank][group] = cmdCycle;
+    rankLastColCycle[r->loc.rank] = cmdCycle;
     bank.curRowHits = r->rowHitSeq;
+    bankAccesses.inc(r->loc.rank * banksPerRank + r->loc.bank);
+    uint64_t burstEnergy = std::round((r->write? eWrCycle : eRdCycle) * r->data_size * burstCycles);
+    (r->write? profWrEnergy : profRdEnergy).inc(burstEnergy);
+    profClassEnergy.inc(r->energyClass, burstEnergy);
+    if (r->arrivalCycle < bank.refEndCycle && cmdCycle >= bank.refEndCycle) {
+        // Queued during (or waited for) the last refresh of its bank
+        profRefreshStalls.inc();
+        profRefreshStallCycles.inc(bank.refEndCycle - std::max(r->arrivalCycle, bank.refStartCycle));
+    }
 
     // Issue response
     if (r->ev) {
@@ -666,26 +910,22 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
 
         uint64_t doneSysCycle = memToSysCycle(minRespCycle) + controllerSysLatency;
         assert(doneSysCycle >= sysCycle);
-
-        ev->release();
-        ev->done(doneSysCycle - preDelay - postDelayRd);
-
-        uint32_t scDelay = doneSysCycle - r->startSysCycle;
-        profReads.inc();
-		//if (tBL == 4)
-	    //    bytesReads.inc(64 * r->data_size);
-		//else if (tBL == 1)
-	    //    bytesReads.inc(32 * r->data_size);
-		//else 
-		//	assert(false);
         bytesReads.inc(16 * r->data_size);
-        profTotalRdLat.inc(scDelay);
         if (rowHit) profReadHits.inc();
-        uint32_t bucket = std::min(NUMBINS-1, scDelay/BINSIZE);
-        latencyHist.inc(bucket, 1);
+
+        // Chunks of a bulk read respond in issue order, so the last one finishes the transfer
+        if (ev->chunkDone()) {
+            ev->release();
+            ev->done(doneSysCycle - preDelay - postDelayRd);
+
+            uint32_t scDelay = doneSysCycle - r->startSysCycle;
+            profReads.inc();
+            if (r->bulk) profBulkReads.inc();
+            profTotalRdLat.inc(scDelay);
+            rdLatHist.inc(scDelay);
+        }
     } else {
         uint32_t scDelay = memToSysCycle(minRespCycle) + controllerSysLatency - r->startSysCycle;
-        profWrites.inc();
         bytesWrites.inc(16 * r->data_size);
 		//if (tBL == 4)
         //	bytesWrites.inc(64 * r->data_size);
@@ -694,21 +934,33 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
 		//else 
 		//	assert(false);
 
-        profTotalWrLat.inc(scDelay);
         if (rowHit) profWriteHits.inc();
+        // Bulk writes are counted once, with the latency of their first chunk
+        if (!r->chunk) {
+            profWrites.inc();
+            if (r->bulk) profBulkWrites.inc();
+            profTotalWrLat.inc(scDelay);
+        }
     }
 
     DEBUG("Served 0x%lx lat %ld clocks", r->addr, minRespCycle-curCycle);
 
     // Dequeue this req
-    queue.remove(ir);
+    uint32_t b = r->loc.rank * banksPerRank + r->loc.bank;
+    queue.remove(r);
     (isWriteQueue? bank.wrReqs : bank.rdReqs).pop_front();
+    resetBankIndex(b, isWriteQueue);
 
     return (rdQueue.empty() && wrQueue.empty())? -1ul : minRespCycle - tCL; // tCL + tCL + 1 - tCL = tBL + 1
 }
 
 void DDRMemory::refresh(uint64_t sysCycle) {
     uint64_t memCycle = sysToMemCycle(sysCycle);
+    if (refreshMode != REFRESH_ALL_BANK) {
+        for (uint32_t rank = 0; rank < ranksPerChannel; rank++) refreshBanks(rank, pickRefreshUnit(rank), memCycle);
+        return;
+    }
+
     uint64_t minRefreshCycle = memCycle;
     for (auto& rankBanks : banks) {
         for (auto& bank : rankBanks) {
@@ -719,18 +971,84 @@ void DDRMemory::refresh(uint64_t sysCycle) {
 
     uint64_t refreshDoneCycle = minRefreshCycle + tRFC;
     assert(tRFC >= tRP);
-    for (auto& rankBanks : banks) {
-        for (auto& bank : rankBanks) {
+    for (uint32_t rank = 0; rank < ranksPerChannel; rank++) {
+        for (auto& bank : banks[rank]) {
             // Close and force the ACT to happen at least at tRFC
             // PRE <-tRP-> ACT, so discount tRP
+            if (bank.open) addActiveInterval(rank, bank.lastActCycle, minRefreshCycle);
             bank.minPreCycle = refreshDoneCycle - tRP;
             bank.open = false;
+            bank.refStartCycle = minRefreshCycle;
+            bank.refEndCycle = refreshDoneCycle;
         }
     }
+    profRefreshes.inc(ranksPerChannel);
+    profRefEnergy.inc(std::round(eRef * ranksPerChannel));
 
     DEBUG("Refresh %ld start %ld done %ld", memCycle, minRefreshCycle, refreshDoneCycle);
 }
 
+// Next unit in round-robin order, preferring idle units that are still due this round
+uint32_t DDRMemory::pickRefreshUnit(uint32_t rank) {
+    uint64_t& refreshed = refreshedUnits[rank];
+    if (refreshed == ((refreshUnits == 64)? ~0ul : (1ul << refreshUnits) - 1)) refreshed = 0;  // new round
+
+    uint32_t unitBanks = banksPerRank / refreshUnits;
+    auto isBusy = [&](uint32_t unit) {
+        for (uint32_t i = 0; i < unitBanks; i++) {
+            const Bank& bank = banks[rank][unit * unitBanks + i];
+            if (!bank.rdReqs.empty() || !bank.wrReqs.empty()) return true;
+        }
+        return false;
+    };
+
+    uint32_t due = -1u, idle = -1u;
+    for (uint32_t i = 0; i < refreshUnits; i++) {
+        uint32_t unit = (nextRefreshUnit[rank] + i) % refreshUnits;
+        if (refreshed & (1ul << unit)) continue;
+        if (due == -1u) due = unit;
+        if (!isBusy(unit)) {
+            idle = unit;
+            break;
+        }
+    }
+    assert(due != -1u);
+
+    uint32_t unit = (idle != -1u)? idle : due;
+    refreshed |= 1ul << unit;
+    if (unit == due) nextRefreshUnit[rank] = (unit + 1) % refreshUnits;
+    return unit;
+}
+
+// REFpb/REFsb: refreshes the banks of one unit; the rest of the rank keeps serving requests.
+// Banks are grouped round-robin, so unit u holds banks [u * unitBanks, (u + 1) * unitBanks),
+// one per bank group with same-bank refresh.
+void DDRMemory::refreshBanks(uint32_t rank, uint32_t unit, uint64_t memCycle) {
+    uint32_t tRFCx = (refreshMode == REFRESH_PER_BANK)? tRFCpb : tRFCsb;
+    uint32_t unitBanks = banksPerRank / refreshUnits;
+
+    uint64_t minRefreshCycle = memCycle;
+    for (uint32_t i = 0; i < unitBanks; i++) {
+        Bank& bank = banks[rank][unit * unitBanks + i];
+        minRefreshCycle = std::max(minRefreshCycle, std::max(bank.minPreCycle, bank.lastCmdCycle));
+    }
+
+    uint64_t refreshDoneCycle = minRefreshCycle + tRFCx;
+    assert(tRFCx >= tRP);
+    for (uint32_t i = 0; i < unitBanks; i++) {
+        Bank& bank = banks[rank][unit * unitBanks + i];
+        if (bank.open) addActiveInterval(rank, bank.lastActCycle, minRefreshCycle);
+        bank.minPreCycle = refreshDoneCycle - tRP;
+        bank.open = false;
+        bank.refStartCycle = minRefreshCycle;
+        bank.refEndCycle = refreshDoneCycle;
+    }
+    profRefreshes.inc();
+    profRefEnergy.inc(std::round(eRef / refreshUnits));  // a round of REFpb/REFsb refreshes as much as a REFab
+
+    DEBUG("Refresh r%d u%d %ld start %ld done %ld", rank, unit, memCycle, minRefreshCycle, refreshDoneCycle);
+}
+
 
 /* Tech/Device timing parameters */
 
@@ -740,8 +1058,81 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
 
     // tBL's below are for 64-byte lines; we adjust as needed
 
+    // Defaults for technologies without bank groups, set below otherwise
+    bankGroupsPerRank = 1;
+    tCCD_L = tCCD_S = tRRD_L = tRRD_S = 0;
+    techRowSize = 0;
+    burstCycles = 1;
+    tRFCpb = tRFCsb = 0;  // derived from tRFC below if not set
+    tRTW = 0;  // no preset sets it, so existing configs keep their timing; see the tRTW option
+
     // Please keep this orderly; go from faster to slower technologies
-    if(tech == "DDR5-4400"){
+    // HBM timings are per pseudo-channel, converted from ns to tCK; with 2 pseudo-channels per
+    // channel, each moves 16B per tCK, like a DDR channel. Rows are 1KB, in 4 bank groups.
+    if (tech == "HBM3-6400") {
+        tCK = 0.625;
+        tBL = 4;
+        tCL = uint32_t(24 / time_scale);
+        tRCD = uint32_t(24 / time_scale);
+        tRTP = uint32_t(8 / time_scale);
+        tRP = uint32_t(24 / time_scale);
+        tRRD = uint32_t(4 / time_scale);
+        tRAS = uint32_t(53 / time_scale);
+        tFAW = uint32_t(20 / time_scale);
+        tWTR = uint32_t(10 / time_scale);
+        tWR = uint32_t(24 / time_scale);
+        tRFC = uint32_t(560 / time_scale);
+        tRFCpb = uint32_t(256 / time_scale);
+        tREFI = uint32_t(6240 / time_scale);
+        tCCD_S = 2;
+        tCCD_L = 4;
+        tRRD_S = uint32_t(4 / time_scale);
+        tRRD_L = uint32_t(6 / time_scale);
+        bankGroupsPerRank = 4;
+        techRowSize = 1024;
+    } else if (tech == "HBM2E-3200") {
+        tCK = 0.625;
+        tBL = 4;
+        tCL = uint32_t(22 / time_scale);
+        tRCD = uint32_t(22 / time_scale);
+        tRTP = uint32_t(8 / time_scale);
+        tRP = uint32_t(22 / time_scale);
+        tRRD = uint32_t(6 / time_scale);
+        tRAS = uint32_t(54 / time_scale);
+        tFAW = uint32_t(48 / time_scale);
+        tWTR = uint32_t(13 / time_scale);
+        tWR = uint32_t(26 / time_scale);
+        tRFC = uint32_t(560 / time_scale);
+        tRFCpb = uint32_t(256 / time_scale);
+        tREFI = uint32_t(6240 / time_scale);
+        tCCD_S = 2;
+        tCCD_L = 4;
+        tRRD_S = uint32_t(6 / time_scale);
+        tRRD_L = uint32_t(10 / time_scale);
+        bankGroupsPerRank = 4;
+        techRowSize = 1024;
+    } else if (tech == "HBM2-2000") {
+        tCK = 1.0;
+        tBL = 4;
+        tCL = uint32_t(14 / time_scale);
+        tRCD = uint32_t(14 / time_scale);
+        tRTP = uint32_t(5 / time_scale);
+        tRP = uint32_t(14 / time_scale);
+        tRRD = uint32_t(4 / time_scale);
+        tRAS = uint32_t(34 / time_scale);
+        tFAW = uint32_t(30 / time_scale);
+        tWTR = uint32_t(8 / time_scale);
+        tWR = uint32_t(16 / time_scale);
+        tRFC = uint32_t(350 / time_scale);
+        tRFCpb = uint32_t(160 / time_scale);
+        tREFI = uint32_t(3900 / time_scale);
+        tCCD_S = 2;
+        tCCD_L = 4;
+        tRRD_S = uint32_t(4 / time_scale);
+        tRRD_L = uint32_t(6 / time_scale);
+        bankGroupsPerRank = 4;
+        techRowSize = 1024;
+    } else if(tech == "DDR5-4400"){
         tCK = 0.454;
         tBL = 8;
         tCL = uint32_t(14 / time_scale);
@@ -754,7 +1145,15 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWTR = uint32_t( 20 / time_scale);// 4/12
         tWR = uint32_t( 30 / time_scale);
         tRFC = uint32_t( 295 / time_scale);
+        tRFCsb = uint32_t( 130 / time_scale);
         tREFI = uint32_t(3900/ time_scale);
+        // Per 32-bit sub-channel: 8 bank groups, BL16 moves a line in 8 tCK
+        tCCD_S = uint32_t( 8 / time_scale);
+        tCCD_L = uint32_t( 11 / time_scale);
+        tRRD_S = uint32_t( 8 / time_scale);
+        tRRD_L = uint32_t( 11 / time_scale);
+        bankGroupsPerRank = 8;
+        burstCycles = 2;
     }else if(tech == "DDR4-3200-CL22"){
         tCK = 0.63;
         // tBL = ;
@@ -770,6 +1169,11 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWR = uint32_t( 24 / time_scale);
         tRFC = uint32_t( 560 / time_scale);
         tREFI = uint32_t(12480 / time_scale);
+        tCCD_S = uint32_t( 4 / time_scale);
+        tCCD_L = uint32_t( 8 / time_scale);
+        tRRD_S = uint32_t( 4 / time_scale);
+        tRRD_L = uint32_t( 8 / time_scale);
+        bankGroupsPerRank = 4;
     }
     else if(tech == "DDR4-3200-CL22-2"){
         tCK = 0.63*2;
@@ -785,6 +1189,11 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWR = uint32_t( 24 / time_scale);
         tRFC = uint32_t( 560 / time_scale);
         tREFI = uint32_t(12480 / time_scale);
+        tCCD_S = uint32_t( 4 / time_scale);
+        tCCD_L = uint32_t( 8 / time_scale);
+        tRRD_S = uint32_t( 4 / time_scale);
+        tRRD_L = uint32_t( 8 / time_scale);
+        bankGroupsPerRank = 4;
     }
     else if (tech == "DDR3-1333-CL10") {
         // from DRAMSim2/ini/DDR3_micron_16M_8B_x4_sg15.ini (Micron)
@@ -851,10 +1260,16 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         panic("Unknown technology %s, you'll need to define it", techName);
     }
 
+    // Per-bank and same-bank refreshes take a bit under half an all-bank refresh
+    if (!tRFCpb) tRFCpb = std::max(tRFC * 9 / 20, tRP);
+    if (!tRFCsb) tRFCsb = std::max(tRFC * 9 / 20, tRP);
+
     // Check all params were set
     assert(tCK > 0.0);
     assert(tBL && tCL && tRCD && tRTP && tRP && tRRD && tRAS && tFAW && tWTR && tWR && tRFC && tREFI);
 
+    initEnergy(tech, tCK);
+
     if (isPow2(lineSize) && lineSize >= 64) {
         tBL = lineSize*tBL/64;
     } else if (lineSize == 32) {
@@ -868,3 +1283,148 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
     memFreqKHz = (uint64_t)(1e9/tCK/1e3);
 }
 
+/* Energy, following Micron's TN-41-01 (as MemChannelBase does with its MemParam).
+ * Currents are in mA per device, for typical datasheet parts of each family, and
+ * devices are those sharing a rank's command bus (a single stack channel for HBM).
+ * mA * V * ns = pJ.
+ */
+void DDRMemory::initEnergy(const std::string& tech, double tCK) {
+    double vdd, idd0, idd2n, idd3n, idd4r, idd4w, idd5;
+    uint32_t devices;
+    if (tech.compare(0, 4, "HBM3") == 0) {
+        // Per pseudo-channel
+        vdd = 1.1; idd0 = 65; idd2n = 30; idd3n = 40; idd4r = 200; idd4w = 190; idd5 = 250;
+        devices = 1;
+    } else if (tech.compare(0, 3, "HBM") == 0) {
+        vdd = 1.2; idd0 = 65; idd2n = 28; idd3n = 38; idd4r = 190; idd4w = 180; idd5 = 250;
+        devices = 1;
+    } else if (tech.compare(0, 4, "DDR5") == 0) {
+        // 16Gb x8, four per 32-bit sub-channel
+        vdd = 1.1; idd0 = 60; idd2n = 46; idd3n = 61; idd4r = 230; idd4w = 200; idd5 = 277;
+        devices = 4;
+    } else if (tech.compare(0, 4, "DDR4") == 0) {
+        // 8Gb x8
+        vdd = 1.2; idd0 = 58; idd2n = 37; idd3n = 52; idd4r = 168; idd4w = 165; idd5 = 250;
+        devices = 8;
+    } else {
+        // DDR3, 4Gb x8
+        vdd = 1.5; idd0 = 55; idd2n = 32; idd3n = 38; idd4r = 157; idd4w = 128; idd5 = 235;
+        devices = 8;
+    }
+
+    double scale = vdd * tCK * devices;  // pJ per mA and memory cycle
+    uint32_t tRC = tRAS + tRP;
+    eActPre = std::max(0.0, (idd0 * tRC - (idd3n * tRAS + idd2n * tRP)) * scale);
+    eRdCycle = (idd4r - idd3n) * scale;
+    eWrCycle = (idd4w - idd3n) * scale;
+    eRef = (idd5 - idd3n) * tRFC * scale;
+    eBgPrecharged = idd2n * scale;
+    eBgActive = idd3n * scale;
+}
+
+// Counts the cycles a rank has rows open. Intervals arrive roughly in time order, so
+// only the part past the last counted interval is added.
+void DDRMemory::addActiveInterval(uint32_t rank, uint64_t actCycle, uint64_t preCycle) {
+    uint64_t start = std::max(actCycle, rankActiveEnd[rank]);
+    if (preCycle > start) {
+        profActiveCycles.inc(preCycle - start);
+        rankActiveEnd[rank] = preCycle;
+    }
+}
+
+uint64_t DDRMemory::getBackgroundEnergy() {
+    uint64_t rankCycles = sysToMemCycle(zinfo->globPhaseCycles) * ranksPerChannel;
+    uint64_t activeCycles = std::min(profActiveCycles.get(), rankCycles);
+    return std::round(eBgPrecharged * (rankCycles - activeCycles) + eBgActive * activeCycles);
+}
+
+uint64_t DDRMemory::getStaticEnergy() {
+    return profRefEnergy.get() + getBackgroundEnergy();
+}
+
+uint32_t DDRMemory::getTechPseudoChannels(const char* tech) {
+    std::string t(tech);
+    return (t.compare(0, 3, "HBM") == 0 || t.compare(0, 4, "DDR5") == 0)? 2 : 1;
+}
+
+
+uint32_t DDRMemory::parseBulkPriority(const char* str) {
+    std::string p(str);
+    if (p == "fcfs") return BULK_FCFS;
+    else if (p == "demand") return BULK_DEMAND_FIRST;
+    else if (p == "bulk") return BULK_FIRST;
+    panic("Invalid bulk priority %s (fcfs, demand or bulk)", str);
+}
+
+uint32_t DDRMemory::parseRefreshMode(const char* str) {
+    std::string m(str);
+    if (m == "all") return REFRESH_ALL_BANK;
+    else if (m == "perBank") return REFRESH_PER_BANK;
+    else if (m == "sameBank") return REFRESH_SAME_BANK;
+    panic("Invalid refresh mode %s (all, perBank or sameBank)", str);
+}
+
+uint64_t DDRPseudoChannels::access(MemReq& req, int type, uint32_t data_size) {
+    const uint32_t numPcs = pcs.size();
+    const uint32_t lineBursts = zinfo->lineSize / 16;
+    const uint32_t lines = data_size / lineBursts;
+    Address addr = req.lineAddr;
+    if (lines <= 1 || data_size % lineBursts) {
+        req.lineAddr = addr / numPcs;
+        uint64_t respCycle = pcs[addr % numPcs]->access(req, type, data_size);
+        req.lineAddr = addr;
+        return respCycle;
+    }
+
+    // Line addr + i lives in pseudo-channel (addr + i) % numPcs, so each
+    // pseudo-channel gets a contiguous run of its own local lines
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    TimingRecord tr;
+    TimingEvent* parent = nullptr;
+    DelayEvent* joinEv = nullptr;
+    if (evRec) {
+        if (type == 0) {
+            DelayEvent* startEv = new (evRec) DelayEvent(0);
+            startEv->setMinStartCycle(req.cycle);
+            assert(!evRec->hasRecord());
+            tr = {addr, req.cycle, req.cycle, req.type, startEv, startEv};
+        } else {
+            tr = evRec->popRecord();
+        }
+        parent = (type == 3 && tr.bgEvent)? tr.bgEvent : tr.endEvent;
+        assert(parent);
+        joinEv = new (evRec) DelayEvent(0);
+        joinEv->setMinStartCycle(tr.reqCycle);
+    }
+
+    // Pieces keep the demand/background class of the whole transfer
+    bool background = (type >= 2);
+    uint64_t respCycle = req.cycle;
+    for (uint32_t i = 0; i < MIN(lines, numPcs); i++) {
+        Address first = addr + i;
+        uint32_t pieceLines = (lines - i + numPcs - 1) / numPcs;
+        if (evRec) {
+            TimingRecord pieceTr = tr;
+            pieceTr.endEvent = parent;
+            pieceTr.bgEvent = background? parent : nullptr;
+            evRec->pushRecord(pieceTr);
+        }
+        req.lineAddr = first / numPcs;
+        uint64_t pieceCycle = pcs[first % numPcs]->access(req, background? 3 : 1, pieceLines * lineBursts);
+        respCycle = MAX(respCycle, pieceCycle);
+        if (evRec) {
+            TimingRecord pieceTr = evRec->popRecord();
+            (background? pieceTr.bgEvent : pieceTr.endEvent)->addChild(joinEv, evRec);
+        }
+    }
+    req.lineAddr = addr;
+
+    if (evRec) {
+        if (type == 0) tr.respCycle = respCycle;
+        tr.type = req.type;
+        if (background) tr.bgEvent = joinEv;
+        else tr.endEvent = joinEv;
+        evRec->pushRecord(tr);
+    }
+    return respCycle;
+}
@@ -27,9 +27,11 @@
  #define DDR_MEM_H_
  
  #include <deque>
+ #include <string>
  
  #include "g_std/g_string.h"
  #include "intrusive_list.h"
+ #include "latency_hist.h"
  #include "memory_hierarchy.h"
  #include "pad.h"
  #include "stats.h"
@@ -88,11 +90,12 @@
          };
          InList<Node> reqList;  // FIFO
          InList<Node> freeList; // LIFO (higher locality)
+         Node* buf;
  
      public:
          void init(size_t size) {
              assert(reqList.empty() && freeList.empty());
-             Node* buf = gm_calloc<Node>(size);
+             buf = gm_calloc<Node>(size);
              for (uint32_t i = 0; i < size; i++) {
                  new (&buf[i]) Node();
                  freeList.push_back(&buf[i]);
@@ -128,6 +131,87 @@
              reqList.remove(i.n);
              freeList.push_back(i.n);
          }
+ 
+         // Nodes come from a single buffer, so an element finds its node by index
+         inline void remove(T* elem) {
+             size_t idx = (reinterpret_cast<char*>(elem) - reinterpret_cast<char*>(&buf[0].elem)) / sizeof(Node);
+             assert(&buf[idx].elem == elem);
+             remove(iterator(&buf[idx]));
+         }
+ };
+ 
+ // Min-heap of banks (rank * banksPerRank + bank), each with a key. Tracks the
+ // position of each bank, so it can be re-keyed or removed in O(log banks).
+ class BankHeap {
+     private:
+         g_vector<uint32_t> heap;
+         g_vector<uint64_t> keys;  // by bank
+         g_vector<uint32_t> pos;   // by bank, NONE if not in the heap
+ 
+     public:
+         static const uint32_t NONE = -1u;
+ 
+         void init(uint32_t numBanks) {
+             heap.clear();
+             keys.resize(numBanks, 0);
+             pos.resize(numBanks, NONE);
+         }
+ 
+         inline bool empty() const { return heap.empty(); }
+         inline bool contains(uint32_t b) const { return pos[b] != NONE; }
+         inline uint32_t top() const { return heap[0]; }
+         inline uint64_t topKey() const { return keys[heap[0]]; }
+ 
+         // Inserts b, or moves it to its new key
+         void update(uint32_t b, uint64_t key) {
+             if (pos[b] == NONE) {
+                 pos[b] = heap.size();
+                 heap.push_back(b);
+             }
+             keys[b] = key;
+             sift(b);
+         }
+ 
+         void remove(uint32_t b) {
+             uint32_t p = pos[b];
+             assert(p != NONE);
+             uint32_t last = heap.back();
+             heap.pop_back();
+             pos[b] = NONE;
+             if (last != b) {
+                 heap[p] = last;
+                 pos[last] = p;
+                 sift(last);
+             }
+         }
+ 
+         inline uint32_t pop() {
+             uint32_t b = top();
+             remove(b);
+             return b;
+         }
+ 
+     private:
+         inline bool less(uint32_t b1, uint32_t b2) const { return keys[b1] < keys[b2] || (keys[b1] == keys[b2] && b1 < b2); }
+ 
+         void sift(uint32_t b) {
+             uint32_t p = pos[b];
+             while (p > 0 && less(b, heap[(p - 1) / 2])) {
+                 heap[p] = heap[(p - 1) / 2];
+                 pos[heap[p]] = p;
+                 p = (p - 1) / 2;
+             }
+             while (2 * p + 1 < heap.size()) {
+                 uint32_t c = 2 * p + 1;
+                 if (c + 1 < heap.size() && less(heap[c + 1], heap[c])) c++;
+                 if (!less(heap[c], b)) break;
+                 heap[p] = heap[c];
+                 pos[heap[p]] = p;
+                 p = c;
+             }
+             heap[p] = b;
+             pos[b] = p;
+         }
  };
  
  class DDRMemoryAccEvent;
@@ -151,6 +235,13 @@
              uint32_t data_size; // access data size. 1 for cacheline, 64 for page
  
              uint64_t rowHitSeq; // sequence number used to throttle max # row hits
+             uint64_t seq;       // queue order, older requests first
+ 
+             // Bulk transfers (more than a line) are split into one column-command
+             // stream per row they touch; chunk numbers them in address order
+             bool bulk;
+             uint32_t chunk;
+             uint32_t energyClass;
  
              // Cycle accounting
              uint64_t arrivalCycle;  // in memCycles
@@ -169,6 +260,7 @@
              uint64_t minPreCycle;   // if !open, time of last PRE; if open, min cycle PRE can be issued
              uint64_t lastActCycle;  // cycle of last ACT command
              uint64_t lastCmdCycle;  // RD/WR command, used for refreshes only
+             uint64_t refStartCycle, refEndCycle;  // last refresh of this bank
  
              uint64_t curRowHits;    // row hits on the currently opened row
  
@@ -186,14 +278,27 @@
          // Equivalent to first cycle that the data bus can be used
          uint64_t minRespCycle;
          bool lastCmdWasWrite;
+         uint32_t lastCmdRank, lastCmdGroup;  // of the last RD/WR, to interleave bank groups
  
          static const uint32_t JEDEC_BUS_WIDTH = 64;
          const uint32_t lineSize, ranksPerChannel, banksPerRank;
+         uint32_t bankGroupsPerRank;  // banks are assigned to groups round-robin
          const uint32_t controllerSysLatency;  // in sysCycles
          const uint32_t queueDepth;
          const uint32_t rowHitLimit; // row hits not prioritized in FR-FCFS beyond this point
          const bool deferredWrites;
          const bool closedPage;
+         const uint32_t bulkPriority;  // a BulkPriority
+         const bool xorHash;  // XOR-fold the row into the bank and rank bits
+         const uint32_t refreshMode;  // a RefreshMode
+ 
+         /* Write drains (deferred writes only). Writes take priority over reads
+          * above writeHighMark queued writes, and keep it until the queue drops
+          * to writeLowMark. Below that, writes are only drained opportunistically,
+          * when no reads are queued and at least idleDrainMin writes are.
+          */
+         const uint32_t writeHighMark, writeLowMark;
+         const uint32_t idleDrainMin;
          const uint32_t domain;
  
          // DRAM timing parameters -- initialized in initTech()
@@ -207,14 +312,25 @@
          uint32_t tRAS;   // ACT to PRE
          uint32_t tFAW;   // No more than 4 ACTs per rank in this window
          uint32_t tWTR;   // end of WR burst to RD command
+         uint32_t tRTW;   // idle data bus cycles between a RD burst and a WR burst (0 unless configured)
          uint32_t tWR;    // end of WR burst to PRE
          uint32_t tRFC;   // Refresh to ACT (refresh leaves rows closed)
+         uint32_t tRFCpb; // Per-bank refresh to ACT
+         uint32_t tRFCsb; // Same-bank refresh to ACT
          uint32_t tREFI;  // Refresh interval
+         // Bank-group timing, 0 where the technology has no bank groups
+         uint32_t tCCD_L; // CAS to CAS, same bank group
+         uint32_t tCCD_S; // CAS to CAS, different bank group
+         uint32_t tRRD_L; // ACT to ACT, same bank group
+         uint32_t tRRD_S; // ACT to ACT, different bank group
+         uint32_t techRowSize;  // row buffer bytes, 0 to derive it from the page size
+         uint32_t burstCycles;  // data bus cycles per 16B burst (2 on 32-bit DDR5 sub-channels)
  
          // Address mapping information
          uint32_t colShift, colMask;
          uint32_t rankShift, rankMask;
          uint32_t bankShift, bankMask;
+         uint32_t bankBits, rankBits;
          uint64_t rowShift;  // row's always top
  
          uint32_t minRdLatency;
@@ -223,9 +339,47 @@
  
          RequestQueue<Request> rdQueue, wrQueue;
          std::deque<Request> overflowQueue;
+         uint64_t nextSeq;
+         g_vector<Request> bulkChunks;  // scratch for enqueue()
+ 
+         /* Per-bank and same-bank refresh work in rounds of refreshUnits REF
+          * commands per tREFI and rank. A unit is one bank (REFpb) or the
+          * banks with the same index in every bank group (REFsb). Units are
+          * targeted round-robin, but a REF skips ahead to a unit without
+          * queued requests if there is one left in the round.
+          */
+         uint32_t refreshUnits;
+ 
+         /* IDD-based energy (see initEnergy()), in pJ per command, per data bus
+          * cycle of a burst, or per rank and memory cycle for the background.
+          * A rank is in active standby while any of its banks has a row open.
+          */
+         double eActPre, eRdCycle, eWrCycle, eRef;
+         double eBgPrecharged, eBgActive;
+         g_vector<uint64_t> rankActiveEnd;  // per rank, end of the last row-open interval counted
+         g_vector<uint32_t> nextRefreshUnit;   // per rank
+         g_vector<uint64_t> refreshedUnits;    // per rank, bitmask of the units refreshed this round
+ 
+         /* Scheduling index, one per queue. Banks with queued requests are either
+          * pending, keyed by a lower bound of the cycle their head request can
+          * issue, or possibly ready, keyed by the priority and seq of their head request.
+          * Bounds only grow as commands issue, and are reset when the head
+          * request of the bank changes, or when an ACT or auto-precharge from
+          * the other queue changes the bank's open row (with deferredWrites).
+          * Debug builds check each choice against linearSchedule().
+          */
+         struct SchedIndex {
+             BankHeap pending;
+             BankHeap ready;
+         };
+         SchedIndex rdIndex, wrIndex;
+         g_vector<uint32_t> schedStash;  // ready banks passed over in trySchedule
  
          g_vector< g_vector<Bank> > banks; // indexed by rank, bank
          g_vector<ActWindow> rankActWindows;
+         // Last ACT and RD/WR command cycles, per rank and per bank group (indexed by rank, group)
+         g_vector<uint64_t> rankLastActCycle, rankLastColCycle;
+         g_vector< g_vector<uint64_t> > groupLastActCycle, groupLastColCycle;
  
          // Event scheduling
          SchedEvent* nextSchedEvent;
@@ -240,8 +394,19 @@
          Counter bytesReads, bytesWrites;
          Counter profTotalRdLat, profTotalWrLat;
          Counter profReadHits, profWriteHits;  // row buffer hits
-         VectorCounter latencyHist;
-         static const uint32_t BINSIZE = 10, NUMBINS = 100;
+         Counter profBulkReads, profBulkWrites, profBulkChunks;
+         VectorCounter bankAccesses;  // RD/WR commands per bank (indexed by rank * banksPerRank + bank)
+         Counter profRefreshes;       // REF commands
+         Counter profRefreshStalls;   // RD/WR delayed by a refresh of their bank
+         Counter profRefreshStallCycles;
+         Counter profActEnergy, profRdEnergy, profWrEnergy, profRefEnergy;  // pJ
+         VectorCounter profClassEnergy;  // ACT/PRE and RD/WR energy, per EnergyClass
+         Counter profActiveCycles;       // rank-cycles in active standby
+         Counter profRdToWr, profWrToRd;  // data bus turnarounds
+         Counter profTurnaroundCycles;    // cycles RD/WR commands waited for tWTR/tRTW
+         Counter profDrainsHigh, profDrainsIdle;  // write drain episodes, by cause
+         Counter profDrainWrites;         // writes issued during drains
+         LatencyHistogram rdLatHist;  // in sysCycles, like rdlat
          PAD();
  
          //In KHz, though it does not matter so long as they are consistent and fine-grain enough (not Hz because we multiply
@@ -261,10 +426,32 @@
          }
  
      public:
+         // Scheduling priority of bulk transfers (page fills, migrations) vs. demand requests
+         enum BulkPriority { BULK_FCFS, BULK_DEMAND_FIRST, BULK_FIRST };
+         static uint32_t parseBulkPriority(const char* str);
+ 
+         /* Accesses are classified for energy accounting from what the bound
+          * phase sees: sub-line accesses are metadata (tags, counters), the rest
+          * of the off-critical-path ones (types 2 and 3) are migration traffic
+          * (fills, evictions, writebacks), and everything else is demand.
+          */
+         enum EnergyClass { ENERGY_DEMAND, ENERGY_METADATA, ENERGY_MIGRATION, ENERGY_CLASSES };
+ 
+         // All-bank (REFab), per-bank (REFpb) or same-bank (REFsb) refresh
+         enum RefreshMode { REFRESH_ALL_BANK, REFRESH_PER_BANK, REFRESH_SAME_BANK };
+         static uint32_t parseRefreshMode(const char* str);
+ 
          DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerChannel, uint32_t _banksPerRank,
              uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, uint32_t _controllerSysLatency,
              uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage,
-             uint32_t _domain, g_string& _name, uint32_t _tBL = 4, double time_scale = 1.0);
+             uint32_t _domain, g_string& _name, uint32_t _tBL = 4, double time_scale = 1.0,
+             uint32_t _rowSize = 0, uint32_t _bankGroupsPerRank = 0, uint32_t _bulkPriority = BULK_FCFS,
+             bool _xorHash = false, uint32_t _refreshMode = REFRESH_ALL_BANK,
+             uint32_t _writeHighMark = -1u, uint32_t _writeLowMark = -1u, uint32_t _idleDrainMin = 1,
+             uint32_t _tRTW = -1u);
+
+         // HBM pseudo-channels and DDR5 sub-channels: two per channel
+         static uint32_t getTechPseudoChannels(const char* tech);
  
          void initStats(AggregateStat* parentStat);
          const char* getName() {return name.c_str();}
@@ -278,9 +465,12 @@
          // A cacheline takes 4 bursts
          uint64_t access(MemReq& req, int type, uint32_t data_size = 4);
          uint64_t access(MemReq& req) { return access(req, 0, 4); };
-         uint64_t cxl_access(MemReq& req, int type, uint32_t data_size = 4);
  
  
+         // Energy so far, in pJ. Static energy is refresh plus background.
+         uint64_t getClassEnergy(uint32_t energyClass) const { return profClassEnergy.count(energyClass); }
+         uint64_t getStaticEnergy();
+ 
          // Weave phase interface
          void enqueue(DDRMemoryAccEvent* ev, uint64_t cycle);
          void refresh(uint64_t sysCycle);
@@ -291,13 +481,57 @@
  
      private:
          AddrLoc mapLineAddr(Address lineAddr);
+         inline uint32_t getBankGroup(uint32_t bank) const { return bank % bankGroupsPerRank; }
+         inline InList<Request>& getBankQueue(uint32_t b, bool write) {
+             Bank& bank = banks[b / banksPerRank][b % banksPerRank];
+             return write? bank.wrReqs : bank.rdReqs;
+         }
+         void resetBankIndex(uint32_t b, bool write);
  
+         void enqueueRequest(const Request& r, uint64_t memCycle, uint64_t sysCycle);
          void queue(Request* req, uint64_t memCycle);
  
+         // Demoted requests go after every request of the other class, in the bank queues and across banks
+         static const uint64_t LOW_PRIO_SEQ = 1ul << 62;
+         inline bool isLowPrio(const Request& r) const {
+             return (bulkPriority == BULK_DEMAND_FIRST && r.bulk) || (bulkPriority == BULK_FIRST && !r.bulk);
+         }
+         inline uint64_t getSchedKey(const Request& r) const { return r.seq + (isLowPrio(r)? LOW_PRIO_SEQ : 0); }
+ 
          inline uint64_t trySchedule(uint64_t curCycle, uint64_t sysCycle);
          uint64_t findMinCmdCycle(const Request& r) const;
+         Request* linearSchedule(bool isWriteQueue, uint64_t curCycle);
  
          void initTech(const char* tech, double time_scale);
+         void initEnergy(const std::string& tech, double tCK);
+         void addActiveInterval(uint32_t rank, uint64_t actCycle, uint64_t preCycle);
+         uint64_t getBackgroundEnergy();
+         uint32_t pickRefreshUnit(uint32_t rank);
+         void refreshBanks(uint32_t rank, uint32_t unit, uint64_t memCycle);
+ };
+
+ // HBM pseudo-channels (or DDR5 sub-channels): each has its own banks and data
+ // bus, and they split the address space of one channel with line interleaving.
+ // The command bus they share is not modeled.
+ class DDRPseudoChannels : public MemObject {
+     private:
+         g_vector<DDRMemory*> pcs;
+         const g_string name;
+
+     public:
+         DDRPseudoChannels(const g_vector<DDRMemory*>& _pcs, g_string& _name) : pcs(_pcs), name(_name) {}
+
+         void initStats(AggregateStat* parentStat) {
+             for (auto pc : pcs) pc->initStats(parentStat);
+         }
+         const char* getName() {return name.c_str();}
+
+         // Transfers of more than one line are split by line across the
+         // pseudo-channels, which serve their pieces in parallel
+         uint64_t access(MemReq& req, int type, uint32_t data_size);
+         uint64_t access(MemReq& req) { return access(req, 0, 4); }
+         uint64_t rd_dram_tag_latency(MemReq& req, uint32_t data_size) { return pcs[0]->rd_dram_tag_latency(req, data_size); }
+         uint64_t wt_dram_tag_latency(MemReq& req, uint32_t data_size) { return pcs[0]->wt_dram_tag_latency(req, data_size); }
  };
  
 
@@ -28,11 +28,13 @@
 
 #include <map>
 #include <string>
+#include "bithacks.h"
 #include "g_std/g_string.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
 #include "stats.h"
 #include "config.h"
+#include "zsim.h"
 
 namespace DRAMSim {
     class MultiChannelMemorySystem;
@@ -89,20 +91,33 @@ class SplitAddrMemory : public MemObject {
         const g_vector<MemObject*> mems;
         const g_string name;
 		uint32_t _mapping_granu;   
+		bool _mapping_hash;
+		VectorCounter _ctrl_accesses;
     public:
         SplitAddrMemory(const g_vector<MemObject*>& _mems, const char* _name, Config& config) 
 			: mems(_mems), name(_name) 
 		{
 			// 64 cachelines = 4096 bytes (page granularity mapping)
 			_mapping_granu = config.get<uint32_t>("sys.mem.mapGranu", 64); 
+			// Permute the controller of each granule with the XOR-folded upper address bits
+			_mapping_hash = config.get<bool>("sys.mem.mapHash", false);
 		}
 
-        uint64_t access(MemReq& req) {
-            Address addr = req.lineAddr;
-			uint32_t mem = (addr / _mapping_granu) % mems.size();
+        // The procMask bits are kept, so controllers can still tell processes apart
+        Address ctrlAddress(Address addr, uint32_t& mem) const {
+            Address procBits = addr & ~(~0UL >> lineBits);
+            addr &= ~0UL >> lineBits;
+			mem = _mapping_hash? hashInterleave(addr / _mapping_granu, mems.size()) : (addr / _mapping_granu) % mems.size();
 			Address sel1 = addr / _mapping_granu / mems.size();
 			Address sel2 = addr % _mapping_granu;
-			req.lineAddr = sel1 * _mapping_granu + sel2;  
+			return procBits | (sel1 * _mapping_granu + sel2);
+        }
+
+        uint64_t access(MemReq& req) {
+            Address addr = req.lineAddr;
+            uint32_t mem;
+			req.lineAddr = ctrlAddress(addr, mem);
+			_ctrl_accesses.atomicInc(mem);
             //uint32_t mem = addr % mems.size();
             //Address ctrlAddr = addr/mems.size();
             //req.lineAddr = ctrlAddr;
@@ -111,12 +126,24 @@ class SplitAddrMemory : public MemObject {
             return respCycle;
         }
 
+        void functionalAccess(Address addr, bool isStore) {
+            uint32_t mem;
+            Address ctrlAddr = ctrlAddress(addr, mem);
+            mems[mem]->functionalAccess(ctrlAddr, isStore);
+        }
+
         const char* getName() {
             return name.c_str();
         }
 
         void initStats(AggregateStat* parentStat) {
             for (auto mem : mems) mem->initStats(parentStat);
+            AggregateStat* splitStats = new AggregateStat();
+            splitStats->init(name.c_str(), "Address splitter stats");
+            _ctrl_accesses.init("ctrlAcc", "Requests per memory controller", mems.size()); splitStats->append(&_ctrl_accesses);
+            auto imbalance = makeLambdaStat([this]() { return vectorImbalance(_ctrl_accesses); });
+            imbalance->init("ctrlImbalance", "Max over mean requests per memory controller, x1000"); splitStats->append(imbalance);
+            parentStat->append(splitStats);
         }
 };
 
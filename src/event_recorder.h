@@ -43,6 +43,7 @@ public:
     AccessType type;
     TimingEvent* startEvent;
     TimingEvent* endEvent;
+    TimingEvent* bgEvent;  // last off-critical-path event, used to chain background accesses
 
     bool isValid() const { return startEvent; }
     void clear() { startEvent = nullptr; }
@@ -120,6 +121,8 @@ class EventRecorder : public GlobAlloc {
             if (lastStartSlack != startSlack) lastStartSlack = startSlack;
         }
 
+        const slab::SlabAlloc& getSlabAlloc() const {return slabAlloc;}
+
         uint32_t getSourceId() const {return srcId;}
         void setSourceId(uint32_t i) {srcId = i;}
 
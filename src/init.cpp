@@ -31,6 +31,7 @@
 #include <string>
 #include <sys/time.h>
 #include <vector>
+#include "adaptive_phase.h"
 #include "cache.h"
 #include "cache_arrays.h"
 #include "config.h"
@@ -174,22 +175,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         //Partition mapper
         // TODO: One partition mapper per cache (not bank).
         string partMapper = config.get<const char*>(prefix + "repl.partMapper", "Core");
-        PartMapper* pm = nullptr;
-        if (partMapper == "Core") {
-            pm = new CorePartMapper(zinfo->numCores); //NOTE: If the cache is not fully shared, trhis will be inefficient...
-        } else if (partMapper == "InstrData") {
-            pm = new InstrDataPartMapper();
-        } else if (partMapper == "InstrDataCore") {
-            pm = new InstrDataCorePartMapper(zinfo->numCores);
-        } else if (partMapper == "Process") {
-            pm = new ProcessPartMapper(zinfo->numProcs);
-        } else if (partMapper == "InstrDataProcess") {
-            pm = new InstrDataProcessPartMapper(zinfo->numProcs);
-        } else if (partMapper == "ProcessGroup") {
-            pm = new ProcessGroupPartMapper();
-        } else {
-            panic("Invalid repl.partMapper %s on %s", partMapper.c_str(), name.c_str());
-        }
+        PartMapper* pm = BuildPartMapper(partMapper.c_str(), name.c_str());
 
         // Partition monitor
         uint32_t umonLines = config.get<uint32_t>(prefix + "repl.umonLines", 256);
@@ -303,7 +289,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 }
 
 // NOTE: frequency is SYSTEM frequency; mem freq specified in tech
-DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string name, const string& prefix) {
+MemObject* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string name, const string& prefix) {
     uint32_t ranksPerChannel = config.get<uint32_t>(prefix + "ranksPerChannel", 4);
     uint32_t banksPerRank = config.get<uint32_t>(prefix + "banksPerRank", 8);  // DDR3 std is 8
     uint32_t pageSize = config.get<uint32_t>(prefix + "pageSize", 8*1024);  // 1Kb cols, x4 devices
@@ -324,9 +310,37 @@ DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency,
     uint32_t queueDepth = config.get<uint32_t>(prefix + "queueDepth", 16);
     uint32_t controllerLatency = config.get<uint32_t>(prefix + "controllerLatency", 10);  // in system cycles
 
-    auto mem = new DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech,
-            addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name);
-    return mem;
+    // Row buffer bytes and bank groups per rank, 0 for the technology defaults
+    uint32_t rowSize = config.get<uint32_t>(prefix + "rowSize", 0);
+    uint32_t bankGroups = config.get<uint32_t>(prefix + "bankGroups", 0);
+    uint32_t pseudoChannels = config.get<uint32_t>(prefix + "pseudoChannels", DDRMemory::getTechPseudoChannels(tech));
+    assert(pseudoChannels > 0);
+
+    // Bulk transfers (page fills, migrations) vs. demand requests: fcfs, demand (first) or bulk (first)
+    uint32_t bulkPriority = DDRMemory::parseBulkPriority(config.get<const char*>(prefix + "bulkPriority", "fcfs"));
+    // XOR-fold the row into the bank and rank bits (permutation-based interleaving)
+    bool xorHash = config.get<bool>(prefix + "xorHash", false);
+    // all (REFab), perBank (REFpb, e.g. HBM) or sameBank (REFsb, DDR5)
+    uint32_t refreshMode = DDRMemory::parseRefreshMode(config.get<const char*>(prefix + "refreshMode", "all"));
+
+    // Write drains (with deferWrites), in queued writes: drain from the high watermark down to the low one,
+    // or while there are no reads if at least idleDrainMin writes are queued
+    uint32_t writeHighMark = config.get<uint32_t>(prefix + "writeHighWatermark", 3*queueDepth/4);
+    uint32_t writeLowMark = config.get<uint32_t>(prefix + "writeLowWatermark", queueDepth/4);
+    uint32_t idleDrainMin = config.get<uint32_t>(prefix + "idleDrainMin", 1);
+    // Idle memory cycles a WR burst leaves after a RD burst, before timing scaling; off by default
+    uint32_t tRTW = config.get<uint32_t>(prefix + "tRTW", 0);
+
+    g_vector<DDRMemory*> pcs;
+    for (uint32_t i = 0; i < pseudoChannels; i++) {
+        g_string pcName = (pseudoChannels == 1)? name : name + g_string("-pc") + g_string(std::to_string(i).c_str());
+        pcs.push_back(new DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech,
+                addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, pcName,
+                4, 1.0, rowSize, bankGroups, bulkPriority, xorHash, refreshMode,
+                writeHighMark, writeLowMark, idleDrainMin, tRTW));
+    }
+    if (pseudoChannels == 1) return pcs[0];
+    return new DDRPseudoChannels(pcs, name);
 }
 
 MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string& name) {
@@ -340,7 +354,9 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
     if (type == "Simple") {
         mem = new SimpleMemory(latency, name, config);
     } else if (type == "DramCache") {
-		mem = new MemoryController(name, frequency, domain, config);
+		MemoryController* mc = new MemoryController(name, frequency, domain, config);
+		zinfo->dramCaches->push_back(mc);
+		mem = mc;
         
 	} else if (type == "MD1") {
         // The following params are for MD1 only
@@ -520,6 +536,10 @@ static void InitSystem(Config& config) {
         mems[i] = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, name);
     }
 
+    //Restore DRAM cache contents from a previous run, skipping its warm-up
+    string warmStateFile = config.get<const char*>("sys.mem.warmStateFile", "");
+    if (!warmStateFile.empty()) LoadDramCacheWarmState(warmStateFile.c_str());
+
     if (memControllers > 1) {
         bool splitAddrs = config.get<bool>("sys.mem.splitAddrs", true);
         if (splitAddrs) {
@@ -529,6 +549,11 @@ static void InitSystem(Config& config) {
         }
     }
 
+    if (zinfo->ffWarmup) {
+        if (mems.size() != 1) panic("sim.ffWarmupDramCache needs a single memory controller or sys.mem.splitAddrs = true");
+        zinfo->ffWarmupMem = mems[0];
+    }
+
     //Connect everything
     bool printHierarchy = config.get<bool>("sim.printHierarchy", false);
 
@@ -848,7 +873,7 @@ static void PostInitStats(bool perProcessDir, Config& config) {
                 zinfo->trigger = i;
                 zinfo->eventualStatsBackend->dump(true /*buffered*/);
             };
-            zinfo->eventQueue->insert(makeAdaptiveEvent(getInstrs, dumpStats, 0, zinfo->maxMinInstrs, MAX_IPC*zinfo->phaseLength));
+            zinfo->eventQueue->insert(makeAdaptiveEvent(getInstrs, dumpStats, 0, zinfo->maxMinInstrs, MAX_IPC*zinfo->maxPhaseLength));
         }
     }
 
@@ -918,16 +943,29 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
 
     zinfo->numDomains = config.get<uint32_t>("sim.domains", 1);
     uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", MAX((uint32_t)1, zinfo->numDomains/2)); //gives a bit of parallelism, TODO tune
-    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads);
+    bool contentionStealing = config.get<bool>("sim.contentionStealing", false); //claim domains dynamically, see contention_sim.cpp
+    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads, contentionStealing);
     zinfo->contentionSim->initStats(zinfo->rootStat);
     zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
 
     zinfo->traceWriters = new g_vector<AccessTraceWriter*>();
 
+    zinfo->dramCaches = new g_vector<MemoryController*>();
+    string warmStateSaveFile = config.get<const char*>("sys.mem.warmStateSaveFile", (string(zinfo->outputDir) + "/dramcache.warm").c_str());
+    zinfo->warmStateSaveFile = gm_strdup(warmStateSaveFile.c_str());
+    zinfo->warmStateSavePhase = config.get<uint64_t>("sys.mem.warmStateSavePhase", 0);
+
     // Global simulation values
     zinfo->numPhases = 0;
 
     zinfo->phaseLength = config.get<uint32_t>("sim.phaseLength", 10000);
+    zinfo->nextPhaseLength = zinfo->phaseLength;
+    zinfo->maxPhaseLength = zinfo->phaseLength;
+    zinfo->phaseCtrl = nullptr;
+    if (config.get<bool>("sim.adaptivePhase", false)) {
+        zinfo->phaseCtrl = new AdaptivePhaseController(config, zinfo->phaseLength);
+        zinfo->maxPhaseLength = zinfo->phaseCtrl->getMaxLength();
+    }
     zinfo->statsPhaseInterval = config.get<uint32_t>("sim.statsPhaseInterval", 100);
     zinfo->freqMHz = config.get<uint32_t>("sys.frequency", 2000);
 
@@ -950,6 +988,18 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     zinfo->ffReinstrument = config.get<bool>("sim.ffReinstrument", false);
     if (zinfo->ffReinstrument) warn("sim.ffReinstrument = true, switching fast-forwarding on a multi-threaded process may be unstable");
 
+    zinfo->ffWarmup = config.get<bool>("sim.ffWarmupDramCache", false);
+    zinfo->ffWarmupFilterLines = config.get<uint32_t>("sim.ffWarmupFilterLines", 16384);
+    zinfo->ffWarmupPeriod = config.get<uint32_t>("sim.ffWarmupSamplePeriod", 1);
+    zinfo->ffWarmupMem = nullptr;
+    if (zinfo->ffWarmup && zinfo->ffReinstrument) panic("sim.ffWarmupDramCache needs memory instrumentation in fast-forward, incompatible with sim.ffReinstrument");
+    if (zinfo->ffWarmupFilterLines && !isPow2(zinfo->ffWarmupFilterLines)) panic("sim.ffWarmupFilterLines must be 0 or a power of 2");
+    if (zinfo->ffWarmupPeriod == 0) panic("sim.ffWarmupSamplePeriod must be >= 1");
+    // Without the filter, L1-hit traffic reaches the DRAM cache and skews its replacement state
+    if (zinfo->ffWarmup && !zinfo->ffWarmupFilterLines && zinfo->ffWarmupPeriod < 64) {
+        warn("sim.ffWarmupFilterLines = 0 with sim.ffWarmupSamplePeriod < 64, fast-forward will be slow and bias DRAM cache replacement towards hot lines");
+    }
+
     zinfo->registerThreads = config.get<bool>("sim.registerThreads", false);
     zinfo->globalPauseFlag = config.get<bool>("sim.startInGlobalPause", false);
 
@@ -1005,6 +1055,7 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
 
     //Sched stats (deferred because of circular deps)
     if (zinfo->sched) zinfo->sched->initStats(zinfo->rootStat);
+    if (zinfo->phaseCtrl) zinfo->phaseCtrl->initStats(zinfo->rootStat);
 
     zinfo->processStats = new ProcessStats(zinfo->rootStat);
 
@@ -0,0 +1,79 @@
+#ifndef LATENCY_HIST_H_
+#define LATENCY_HIST_H_
+
+#include <stdint.h>
+#include "bithacks.h"
+#include "stats.h"
+
+/* Log-linear (HDR-style) latency histogram. Latencies below 2^SUB_BITS cycles
+ * get a bin each; above that, each power of 2 is split into 2^SUB_BITS bins, so
+ * a bin is never wider than 1/2^SUB_BITS of the latencies it holds. Latencies of
+ * 2^MAX_BITS cycles or more fall in the last bin.
+ *
+ * init() registers an aggregate with the bins and the p50/p90/p99/p99.9
+ * percentiles, each reported as the largest latency of its bin.
+ */
+class LatencyHistogram {
+    private:
+        static const uint32_t SUB_BITS = 3;
+        static const uint32_t MAX_BITS = 24;
+        static const uint32_t NUM_BINS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+        static const uint64_t SUB_MASK = (1 << SUB_BITS) - 1;
+
+        VectorCounter bins;
+
+        static uint32_t getBin(uint64_t lat) {
+            if (lat <= SUB_MASK) return lat;
+            uint32_t msb = ilog2(lat);
+            if (msb >= MAX_BITS) return NUM_BINS - 1;
+            uint32_t shift = msb - SUB_BITS;
+            return ((shift + 1) << SUB_BITS) | ((lat >> shift) & SUB_MASK);
+        }
+
+        static uint64_t getBinLimit(uint32_t bin) {
+            if (bin <= SUB_MASK) return bin;
+            uint32_t shift = (bin >> SUB_BITS) - 1;
+            uint64_t base = (1 << SUB_BITS) | (bin & SUB_MASK);
+            return ((base + 1) << shift) - 1;
+        }
+
+    public:
+        void init(AggregateStat* parentStat, const char* name, const char* desc) {
+            AggregateStat* histStats = new AggregateStat();
+            histStats->init(name, desc);
+            bins.init("bins", "Log-linear latency bins", NUM_BINS); histStats->append(&bins);
+
+            // Percentiles in parts per 100000
+            const struct { const char* name; const char* desc; uint64_t pcm; } percentiles[] = {
+                {"p50", "Median latency", 50000},
+                {"p90", "90th percentile latency", 90000},
+                {"p99", "99th percentile latency", 99000},
+                {"p999", "99.9th percentile latency", 99900},
+            };
+            for (auto& p : percentiles) {
+                uint64_t pcm = p.pcm;
+                auto stat = makeLambdaStat([this, pcm]() { return getPercentile(pcm); });
+                stat->init(p.name, p.desc); histStats->append(stat);
+            }
+            parentStat->append(histStats);
+        }
+
+        inline void inc(uint64_t lat) { bins.inc(getBin(lat)); }
+        inline void atomicInc(uint64_t lat) { bins.atomicInc(getBin(lat)); }
+
+        uint64_t getPercentile(uint64_t pcm) const {
+            uint64_t total = 0;
+            for (uint32_t i = 0; i < NUM_BINS; i++) total += bins.count(i);
+            if (!total) return 0;
+
+            uint64_t rank = (total * pcm + 99999) / 100000;  // 1-based rank of the sample
+            uint64_t seen = 0;
+            for (uint32_t i = 0; i < NUM_BINS; i++) {
+                seen += bins.count(i);
+                if (seen >= rank) return getBinLimit(i);
+            }
+            return getBinLimit(NUM_BINS - 1);
+        }
+};
+
+#endif  // LATENCY_HIST_H_
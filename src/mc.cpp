@@ -1,13 +1,61 @@
 #include "mc.h"
+#include "bithacks.h"
 #include "line_placement.h"
 #include "page_placement.h"
 #include "os_placement.h"
+#include "partition_mapper.h"
+#include "partitioner.h"
 #include "mem_ctrls.h"
 #include "dramsim_mem_ctrl.h"
 #include "ddr_mem.h"
+#include "event_recorder.h"
+#include "timing_event.h"
+#include "cxl_link.h"
 #include "zsim.h"
 #include<iostream>
 
+/**
+ * @brief Periodically re-splits the ways of a partitioned DRAM cache.
+ * Scheduled on the global event queue like the cache partitioners; the
+ * actual lookahead runs in MemoryController::repartition().
+ */
+class DramCachePartitioner : public Partitioner {
+	private:
+		MemoryController* _mc;
+	public:
+		explicit DramCachePartitioner(MemoryController* mc) : Partitioner(1, 1.0, nullptr), _mc(mc) {}
+		void partition() { _mc->repartition(); }
+};
+
+/**
+ * @brief Weave-phase probes around the timing record of a request. The start probe stamps 
+ * 		  the cycle the request starts; the end probe, a child of the record's end event, 
+ * 		  bins the latency. Both wake their children directly, like DelayEvent.
+ */
+class LatencyEndEvent : public DelayEvent {
+	private:
+		MemoryController* _mc;
+		uint8_t _cls;
+	public:
+		uint64_t startCycle;
+		LatencyEndEvent(MemoryController* mc, uint8_t cls) : DelayEvent(0), _mc(mc), _cls(cls), startCycle(0) {}
+		void parentDone(uint64_t cycle) {
+			_mc->recordLatency(_cls, cycle - startCycle);
+			DelayEvent::parentDone(cycle);
+		}
+};
+
+class LatencyStartEvent : public DelayEvent {
+	private:
+		LatencyEndEvent* _end;
+	public:
+		explicit LatencyStartEvent(LatencyEndEvent* end) : DelayEvent(0), _end(end) {}
+		void parentDone(uint64_t cycle) {
+			_end->startCycle = cycle;
+			DelayEvent::parentDone(cycle);
+		}
+};
+
 MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t domain, Config& config)
 	: _name (name)
 {
@@ -41,7 +89,8 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
 		assert(_num_ways == 1);
 	}
 	else if (scheme == "UnisonCache") {
-		assert(_granularity == 4096);
+		// 4KB page or 2MB page
+		assert(_granularity == 4096 || _granularity == 4096 * 512);
 		_scheme = UnisonCache;
 		_footprint_size = config.get<uint32_t>("sys.mem.mcdram.footprint_size");
 	} else if (scheme == "HMA") {
@@ -57,6 +106,7 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
  	else if (scheme == "CacheOnly")
 		_scheme = CacheOnly;
 	else if (scheme == "Tagless") {
+		assert(_granularity == 4096 || _granularity == 4096 * 512);
 		_scheme = Tagless;
 		_next_evict_idx = 0;
 		_footprint_size = config.get<uint32_t>("sys.mem.mcdram.footprint_size");
@@ -71,6 +121,15 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
 		printf("scheme=%s\n", scheme.c_str());
 		assert(false);
 	}
+	_huge_page = false;
+	_page_lines = _chunk_lines = _leaf_lines = 1;
+	if (_scheme != NoCache && _granularity >= 4096) {
+		assert(isPow2(_granularity));
+		_page_lines = _granularity / 64;
+		_huge_page = _page_lines > 64 * 4;
+		_chunk_lines = _huge_page? _page_lines / 64 : 4;
+		_leaf_lines = _huge_page? std::max(_chunk_lines / 64, 4u) : 4;
+	}
 
 	g_string placement_scheme = config.get<const char *>("sys.mem.mcdram.placementPolicy", "LRU");
 	// if(_scheme == SDCache)placement_scheme = "PRR";
@@ -86,7 +145,7 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
         _ext_dram = (SimpleMemory *) gm_malloc(sizeof(SimpleMemory));
 		new (_ext_dram)	SimpleMemory(latency, ext_dram_name, config);
 	} else if (_ext_type == "DDR")
-        _ext_dram = BuildDDRMemory(config, frequency, domain, ext_dram_name, "sys.mem.ext_dram.", 4, 1.0);
+        _ext_dram = BuildDDRMemory(config, frequency, domain, ext_dram_name, "sys.mem.ext_dram.", 4, 1.0, _ext_dram_chans);
 	else if (_ext_type == "MD1") {
     	uint32_t latency = config.get<uint32_t>("sys.mem.ext_dram.latency", 100);
         uint32_t bandwidth = config.get<uint32_t>("sys.mem.ext_dram.bandwidth", 6400);
@@ -105,10 +164,19 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
 		new (_ext_dram) DRAMSimMemory(dramTechIni, dramSystemIni, outputDir, traceName, capacity, cpuFreqHz, latency, domain, name);
 	} else 
         panic("Invalid memory controller type %s", _ext_type.c_str());
+	// cxl_access() reaches the external memory through a CXL link; access() bypasses it.
+	// The link chains the device access after its own events, which only DDRMemory supports.
+	if (_ext_type == "DDR") {
+		g_string link_name = _name + g_string("-cxl");
+		CxlLink * link = (CxlLink *) gm_malloc(sizeof(CxlLink));
+		new (link) CxlLink(_ext_dram, frequency, domain, link_name, config, "sys.mem.ext_dram.cxl.");
+		_ext_dram = link;
+	}
 
 	if (_scheme != NoCache) {		
 		// Configure the MC-Dram (Timing Model)
 		_mcdram_per_mc = config.get<uint32_t>("sys.mem.mcdram.mcdramPerMC", 4);
+		_mcdram_hash = config.get<bool>("sys.mem.mcdram.channelHash", false);
 		//_mcdram = new MemObject * [_mcdram_per_mc];
 		_mcdram = (MemObject **) gm_malloc(sizeof(MemObject *) * _mcdram_per_mc);
 		for (uint32_t i = 0; i < _mcdram_per_mc; i++) {
@@ -121,7 +189,7 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
 	        	//_mcdram[i] = new SimpleMemory(latency, mcdram_name, config);
 			} else if (_mcdram_type == "DDR") {
 				// XXX HACK tBL for mcdram is 1, so for data access, should multiply by 2, for tad access, should multiply by 3. 
-        		_mcdram[i] = BuildDDRMemory(config, frequency, domain, mcdram_name, "sys.mem.mcdram.", 4, timing_scale);
+        		_mcdram[i] = BuildDDRMemory(config, frequency, domain, mcdram_name, "sys.mem.mcdram.", 4, timing_scale, _mcdram_chans);
 			} else if (_mcdram_type == "MD1") {
 				uint32_t latency = config.get<uint32_t>("sys.mem.mcdram.latency", 50);
         		uint32_t bandwidth = config.get<uint32_t>("sys.mem.mcdram.bandwidth", 12800);
@@ -147,14 +215,16 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
 		if (_scheme == Tagless)
 			assert(_num_sets == 1);
 		_cache = (Set *) gm_malloc(sizeof(Set) * _num_sets);
+		_huge_sectors = _huge_page? gm_calloc<HugePageSectors>(_num_sets * _num_ways) : nullptr;
 		for (uint64_t i = 0; i < _num_sets; i ++) {
 			_cache[i].ways = (Way *) gm_malloc(sizeof(Way) * _num_ways);
 			_cache[i].num_ways = _num_ways;
 			for (uint32_t j = 0; j < _num_ways; j++)
 			{
 				_cache[i].ways[j].valid = false;
-				_cache[i].ways[j].valid_vector.resize(64,false);
-				_cache[i].ways[j].dirty_vector.resize(64,false);
+				_cache[i].ways[j].valid_vector.resize(_page_lines,false);
+				_cache[i].ways[j].dirty_vector.resize(_page_lines,false);
+				_cache[i].ways[j].touch_vector.resize(_page_lines,false);
 				// if(_scheme ==BasicCache)
 				// 	for(int k = 0 ; k < 64;k++)
 				// 	{
@@ -177,6 +247,37 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
 		  		_page_placement_policy->initialize(config);
 		}
 	}
+	// Way partitioning of the page-granularity cache. Every partition owns a
+	// contiguous range of ways; UMON curves drive lookahead reallocation.
+	_part_mapper = nullptr;
+	g_string part_mapper = config.get<const char *>("sys.mem.mcdram.partMapper", "None");
+	if (part_mapper != "None") {
+		if (_scheme != UnisonCache && _scheme != HybridCache && _scheme != BasicCache)
+			panic("%s: sys.mem.mcdram.partMapper requires UnisonCache, HybridCache or BasicCache", _name.c_str());
+		_part_mapper = BuildPartMapper(part_mapper.c_str(), _name.c_str());
+		_num_partitions = _part_mapper->getNumPartitions();
+		_part_min_ways = config.get<uint32_t>("sys.mem.mcdram.partMinWays", 1);
+		if (_num_partitions * _part_min_ways > _num_ways)
+			panic("%s: %d partitions with %d min ways do not fit in %ld ways", _name.c_str(), _num_partitions, _part_min_ways, _num_ways);
+		uint32_t umon_lines = config.get<uint32_t>("sys.mem.mcdram.umonLines", 256);
+		uint32_t umon_ways = config.get<uint32_t>("sys.mem.mcdram.umonWays", _num_ways);
+		uint64_t num_pages = _num_sets * _num_ways;
+		if (umon_lines == 0 || num_pages % umon_lines != 0 || !isPow2(num_pages / umon_lines))
+			panic("%s: sys.mem.mcdram.umonLines (%d) must divide the %ld cached pages by a power of 2", _name.c_str(), umon_lines, num_pages);
+		_part_monitor = new UMonMonitor(num_pages, umon_lines, umon_ways, _num_partitions, _num_ways);
+		futex_init(&_part_lock);
+		_part_ways = gm_calloc<uint32_t>(_num_partitions);
+		_way_part = gm_calloc<uint32_t>(_num_ways);
+		_page_part = gm_calloc<uint32_t>(num_pages);
+		_part_pages = gm_calloc<uint64_t>(_num_partitions);
+		uint32_t allocs[_num_partitions];
+		for (uint32_t p = 0; p < _num_partitions; p++)
+			allocs[p] = _num_ways / _num_partitions + (p < _num_ways % _num_partitions ? 1 : 0);
+		setPartitionWays(allocs);
+		uint32_t interval = config.get<uint32_t>("sys.mem.mcdram.partInterval", 5000); // phases
+		zinfo->eventQueue->insert(new Partitioner::PartitionEvent(new DramCachePartitioner(this), interval));
+		info("%s: way-partitioned across %d partitions (%s), repartition every %d phases", _name.c_str(), _num_partitions, part_mapper.c_str(), interval);
+	}
 	if (_scheme == HybridCache) {
 		_tag_buffer = (TagBuffer *) gm_malloc(sizeof(TagBuffer));	
 		new (_tag_buffer) TagBuffer(config);
@@ -190,10 +291,50 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
    _num_miss_per_step = 0;
    _mc_bw_per_step = 0;
    _ext_bw_per_step = 0;
-   for (uint32_t i = 0; i < MAX_STEPS; i++)
-      _miss_rate_trace[i] = 0;
    _num_requests = 0;
-   
+	_mc_bw_total = _ext_bw_total = 0;
+	_mc_bw_folded = _ext_bw_folded = 0;
+
+	// Interval time-series
+	_interval_cycles = config.get<uint64_t>("sys.mem.intervalCycles", 0);
+	if (_interval_cycles) {
+		_next_interval_cycle = _interval_cycles;
+		_interval_buf_size = config.get<uint32_t>("sys.mem.intervalBufferSize", 1024);
+		assert(_interval_buf_size > 0);
+		_interval_buf = gm_calloc<IntervalSample>(_interval_buf_size);
+		_interval_head = _interval_count = 0;
+		memset(&_interval_last, 0, sizeof(IntervalSample));
+		_interval_file = g_string(zinfo->outputDir) + "/" + _name + "-intervals.csv";
+		FILE * f = fopen(_interval_file.c_str(), "w");
+		if (!f) panic("%s: cannot open %s", _name.c_str(), _interval_file.c_str());
+		fprintf(f, "cycle,hits,misses,hitRate,mcBytes,extBytes,metadataBytes,migrateBytes,wbQueue\n");
+		fclose(f);
+	}
+
+	// Demand-sector fetch for BasicCache/Trimma. Defaults to the whole page.
+	// Huge pages default to 4KB sectors.
+	if (_scheme == BasicCache || _scheme == Trimma) {
+		assert(_granularity == 4096 || (_scheme == BasicCache && _granularity == 4096 * 512));
+		_sector_size = config.get<uint32_t>("sys.mem.mcdram.sectorSize", _huge_page? 4096 : _granularity);
+		assert(isPow2(_sector_size) && _sector_size >= 64 && _sector_size <= _granularity);
+	} else
+		_sector_size = _granularity;
+
+	// Eviction writeback buffer
+	_wb_size = config.get<uint32_t>("sys.mem.mcdram.wbBufferSize", 0);
+	_wb_high_watermark = config.get<uint32_t>("sys.mem.mcdram.wbHighWatermark", _wb_size * 3 / 4);
+	_wb_low_watermark = config.get<uint32_t>("sys.mem.mcdram.wbLowWatermark", _wb_size / 4);
+	_wb_idle_cycles = config.get<uint32_t>("sys.mem.mcdram.wbIdleCycles", 200);
+	if (_wb_size) {
+		assert(_wb_low_watermark <= _wb_high_watermark && _wb_high_watermark <= _wb_size);
+		_wb_buffer.reserve(_wb_size);
+	}
+	_ext_last_demand_cycle = 0;
+
+	_src_class = 0;
+	_src_last_migrate = 0;
+	_src_last_metadata = 0;
+	_src_lat_class = gm_calloc<uint8_t>(zinfo->numCores);
 }
 
 uint64_t 
@@ -215,12 +356,24 @@ MemoryController::access(MemReq& req)
     }
 	if (req.type == PUTS)
 		return req.cycle;
+	uint64_t start_cycle = req.cycle;
+	// DRAM traffic class for the channels' energy breakdown; requests built from req
+	// copy it, and migration and metadata ones override it
+	req.setDramClass(MemReq::DRAM_DEMAND);
+	if (_part_mapper) {
+		uint32_t part = _part_mapper->getPartition(req);
+		futex_lock(&_part_lock);
+		_part_monitor->access(part, req.lineAddr / (_granularity / 64));
+		futex_unlock(&_part_lock);
+	}
 
 	if(_scheme == UnisonCache)
 	{
 		
 		if(!is_ideal)req.cycle = unison_cache_access(req);
 		else req.cycle = ideal_unison_access(req);
+		sampleInterval(start_cycle);
+		recordSourceLatency(req, start_cycle, req.cycle);
 		return req.cycle;
 	}
 	
@@ -230,6 +383,8 @@ MemoryController::access(MemReq& req)
 		// else req.cycle = theoretical_basic_cache_access(req);
 		if(!is_ideal) req.cycle = test_cache_access(req);
 		else req.cycle = ideal_cache_access(req);
+		sampleInterval(start_cycle);
+		recordSourceLatency(req, start_cycle, req.cycle);
 		return req.cycle;
 	}
 
@@ -239,6 +394,8 @@ MemoryController::access(MemReq& req)
 		// else req.cycle = theoretical_basic_cache_access(req);
 		if(!is_ideal) req.cycle = test_cache_access(req);
 		else req.cycle = ideal_cache_access(req);
+		sampleInterval(start_cycle);
+		recordSourceLatency(req, start_cycle, req.cycle);
 		return req.cycle;
 	}
 
@@ -261,9 +418,13 @@ MemoryController::access(MemReq& req)
 	_num_requests ++;
 	if (_scheme == NoCache) {
 		///////   load from external dram
- 		req.cycle = _ext_dram->access(req, 0, 4);
+ 		req.cycle = extAccess(req, 0, 4);
 		_numLoadHit.inc();
+		_src_class |= SRC_HIT;
+		updateSourceStats(req);
 		futex_unlock(&_lock);
+		sampleInterval(start_cycle);
+		recordSourceLatency(req, start_cycle, req.cycle);
 		return req.cycle;
 		////////////////////////////////////
 	} 
@@ -274,7 +435,7 @@ MemoryController::access(MemReq& req)
 	
 	ReqType type = (req.type == GETS || req.type == GETX)? LOAD : STORE;
 	Address address = req.lineAddr;
-	uint32_t mcdram_select = (address / 64) % _mcdram_per_mc;
+	uint32_t mcdram_select = selectMcdram(address);
 	Address mc_address = (address / 64 / _mcdram_per_mc * 64) | (address % 64); 
 	//printf("address=%ld, _mcdram_per_mc=%d, mc_address=%ld\n", address, _mcdram_per_mc, mc_address);
 	Address tag = address / (_granularity / 64);
@@ -290,7 +451,11 @@ MemoryController::access(MemReq& req)
  		req.cycle = _mcdram[mcdram_select]->access(req, 0, 4);
 		req.lineAddr = address;
 		_numLoadHit.inc();
+		_src_class |= SRC_HIT;
+		updateSourceStats(req);
 		futex_unlock(&_lock);
+		sampleInterval(start_cycle);
+		recordSourceLatency(req, start_cycle, req.cycle);
 		return req.cycle;
 		////////////////////////////////////
 	}
@@ -321,7 +486,7 @@ MemoryController::access(MemReq& req)
 				req.lineAddr = address;
 			} else {
 				assert(type == STORE);
-	            MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+	            MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 				req.cycle = _mcdram[mcdram_select]->access(tag_probe, 0, 2);
 				_mc_bw_per_step += 2;
 				_numTagLoad.inc();
@@ -377,6 +542,7 @@ MemoryController::access(MemReq& req)
 	{
 		uint64_t cur_cycle = req.cycle;
 		_num_miss_per_step ++;
+		_src_class |= SRC_MISS;
 		if (type == LOAD)
 			_numLoadMiss.inc();
 		else
@@ -396,59 +562,59 @@ MemoryController::access(MemReq& req)
 		}
 		else {
 			if (set_num >= _ds_index)
-	        	replace_way = _page_placement_policy->handleCacheMiss(tag, type, set_num, &_cache[set_num], counter_access);
+	        	replace_way = placePage(req, tag, type, set_num, counter_access);
 		}
 
 		/////// load from external dram
 		if (_scheme == AlloyCache) {
 			if (type == LOAD) {
 				if (!_sram_tag && set_num >= _ds_index)
-					req.cycle = _ext_dram->access(req, 1, 4);
+					req.cycle = extAccess(req, 1, 4);
 				else 
-					req.cycle = _ext_dram->access(req, 0, 4);
+					req.cycle = extAccess(req, 0, 4);
 				_ext_bw_per_step += 4;
 				data_ready_cycle = req.cycle;
 			} else if (type == STORE && replace_way >= _num_ways) {
 				// no replacement
-				req.cycle = _ext_dram->access(req, 0, 4);
+				req.cycle = extAccess(req, 0, 4);
 				_ext_bw_per_step += 4;
 				data_ready_cycle = req.cycle;
 			} else if (type == STORE) { // && replace_way < _num_ways)
 	            MemReq load_req = {address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-				req.cycle = _ext_dram->access(load_req, 0, 4);
+				req.cycle = extAccess(load_req, 0, 4);
 				_ext_bw_per_step += 4;
 				data_ready_cycle = req.cycle;
 			}
 		} else if (_scheme == HMA) { 
-			req.cycle = _ext_dram->access(req, 0, 4);
+			req.cycle = extAccess(req, 0, 4);
 			_ext_bw_per_step += 4;
 			data_ready_cycle = req.cycle;
 		} else if (_scheme == UnisonCache) {
 			if (type == LOAD) {
-				req.cycle = _ext_dram->access(req, 1, 4);
+				req.cycle = extAccess(req, 1, 4);
 				_ext_bw_per_step += 4;
 			} else if (type == STORE && replace_way >= _num_ways) { 
-				req.cycle = _ext_dram->access(req, 1, 4);
+				req.cycle = extAccess(req, 1, 4);
 				_ext_bw_per_step += 4;
 			}
 			data_ready_cycle = req.cycle;
 		} else if (_scheme == HybridCache) {
 			if (hybrid_tag_probe) {
-		        MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+		        MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 				req.cycle = _mcdram[mcdram_select]->access(tag_probe, 0, 2);
 				_mc_bw_per_step += 2;
-				req.cycle = _ext_dram->access(req, 1, 4);
+				req.cycle = extAccess(req, 1, 4);
 				_ext_bw_per_step += 4;
 				_numTagLoad.inc();
 				data_ready_cycle = req.cycle;
 			} else {
-				req.cycle = _ext_dram->access(req, 0, 4);
+				req.cycle = extAccess(req, 0, 4);
 				_ext_bw_per_step += 4;
 				data_ready_cycle = req.cycle;
 			}
 		} else if (_scheme == Tagless) {
 			assert(_ext_dram);
-			req.cycle = _ext_dram->access(req, 0, 4);
+			req.cycle = extAccess(req, 0, 4);
 			_ext_bw_per_step += 4;
 			data_ready_cycle = req.cycle;
 		}
@@ -459,28 +625,35 @@ MemoryController::access(MemReq& req)
 			///// mcdram replacement 
 			// TODO update the address 
 			if (_scheme == AlloyCache) { 
-	            MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+	            MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 				uint32_t size = _sram_tag? 4 : 6;
 				_mcdram[mcdram_select]->access(insert_req, 2, size);
 				_mc_bw_per_step += size;
 				_numTagStore.inc();
 			} else if (_scheme == UnisonCache || _scheme == HybridCache || _scheme == Tagless) {
-				uint32_t access_size = (_scheme == UnisonCache || _scheme == Tagless)? _footprint_size : (_granularity / 64); 
+				uint32_t access_size = (_scheme == UnisonCache || _scheme == Tagless)? _footprint_size : _page_lines; 
+				Address fill_addr = tag * _page_lines;
+				if (_huge_page) {
+					// only the demanded sector of a huge page, the others are fetched on first touch
+					access_size = _leaf_lines;
+					fill_addr += (address - fill_addr) / _leaf_lines * _leaf_lines;
+				}
 				// load page from ext dram
-		        MemReq load_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-				_ext_dram->access(load_req, 2, access_size*4);
+		        MemReq load_req = {fill_addr, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+				extAccess(load_req, 2, access_size*4);
 				_ext_bw_per_step += access_size * 4;
 				// store the page to mcdram
-		        MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+		        MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 				_mcdram[mcdram_select]->access(insert_req, 2, access_size*4);
 				_mc_bw_per_step += access_size * 4;
 				if (_scheme == Tagless) {
-		        	MemReq load_gipt_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-		        	MemReq store_gipt_req = {tag * 64, PUTS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-					_ext_dram->access(load_gipt_req, 2, 2); // update GIPT
-					_ext_dram->access(store_gipt_req, 2, 2); // update GIPT
+		        	MemReq load_gipt_req = {tag * _page_lines, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
+		        	MemReq store_gipt_req = {tag * _page_lines, PUTS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
+					extAccess(load_gipt_req, 2, 2); // update GIPT
+					extAccess(store_gipt_req, 2, 2); // update GIPT
 					_ext_bw_per_step += 4;
 				} else if (!_sram_tag) {
+					insert_req.setDramClass(MemReq::DRAM_METADATA);
 					_mcdram[mcdram_select]->access(insert_req, 2, 2); // store tag
 					_mc_bw_per_step += 2;
 				}
@@ -514,12 +687,12 @@ MemoryController::access(MemReq& req)
 
            		_tlb[replaced_tag].way = _num_ways;
 				// only used for UnisonCache
-				uint32_t unison_dirty_lines = __builtin_popcountll(_tlb[replaced_tag].dirty_bitvec) * 4;
-				uint32_t unison_touch_lines = __builtin_popcountll(_tlb[replaced_tag].touch_bitvec) * 4;
+				uint32_t unison_dirty_lines = getDirtyLines(replaced_tag, getFrame(set_num, replace_way));
+				uint32_t unison_touch_lines = getTouchedLines(replaced_tag, getFrame(set_num, replace_way));
 				if (_scheme == UnisonCache || _scheme == Tagless) {
 					assert(unison_touch_lines > 0);
-					assert(unison_touch_lines <= 64);
-					assert(unison_dirty_lines <= 64);
+					assert(unison_touch_lines <= _page_lines);
+					assert(unison_dirty_lines <= _page_lines);
 					_numTouchedLines.inc(unison_touch_lines);
 					_numEvictedLines.inc(unison_dirty_lines);
 				}
@@ -532,44 +705,30 @@ MemoryController::access(MemReq& req)
 					if (_scheme == AlloyCache) {
 						if (type == STORE) {
 							if (_sram_tag) {
-			        	    	MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			        	    	MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 								req.cycle = _mcdram[mcdram_select]->access(load_req, 2, 4);
 								_mc_bw_per_step += 4;
 								//_numTagLoad.inc();
 							}
 						}
-		        	    MemReq wb_req = {_cache[set_num].ways[replace_way].tag, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-						_ext_dram->access(wb_req, 2, 4);
+		        	    MemReq wb_req = {_cache[set_num].ways[replace_way].tag, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+						extAccess(wb_req, 2, 4);
 						_ext_bw_per_step += 4;
 					} else if (_scheme == HybridCache) {
-						// load page from mcdram
-				        MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-						_mcdram[mcdram_select]->access(load_req, 2, (_granularity / 64)*4);
-						_mc_bw_per_step += (_granularity / 64)*4;
-						// store page to ext dram
-						// TODO. this event should be appended under the one above. 
-						// but they are parallel right now.
-	        	    	MemReq wb_req = {_cache[set_num].ways[replace_way].tag * 64, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-						_ext_dram->access(wb_req, 2, (_granularity / 64) * 4);
-						_ext_bw_per_step += (_granularity / 64) * 4;
+						if (_huge_page)
+							writebackDirtySectors(req, replaced_tag, getFrame(set_num, replace_way), mc_address, mcdram_select, false, cur_cycle);
+						else // the whole page is written back
+							evictDirtyPage(req, replaced_tag * _page_lines, mc_address, mcdram_select, 1, _page_lines * 4, false, cur_cycle);
 					} else if (_scheme == UnisonCache || _scheme == Tagless) {
 						assert(unison_dirty_lines > 0);
-						// load page from mcdram
-						assert(unison_dirty_lines <= 64);
-				        MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-						_mcdram[mcdram_select]->access(load_req, 2, unison_dirty_lines*4);
-						_mc_bw_per_step += unison_dirty_lines*4;
-						// store page to ext dram
-						// TODO. this event should be appended under the one above. 
-						// but they are parallel right now.
-	        	    	MemReq wb_req = {_cache[set_num].ways[replace_way].tag * 64, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-						_ext_dram->access(wb_req, 2, unison_dirty_lines*4);
-						_ext_bw_per_step += unison_dirty_lines*4;
+						assert(unison_dirty_lines <= _page_lines);
+						// only dirty sectors are written back
+						writebackDirtySectors(req, replaced_tag, getFrame(set_num, replace_way), mc_address, mcdram_select, false, cur_cycle);
 						if (_scheme == Tagless) {
-				        	MemReq load_gipt_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-				        	MemReq store_gipt_req = {tag * 64, PUTS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-							_ext_dram->access(load_gipt_req, 2, 2); // update GIPT
-							_ext_dram->access(store_gipt_req, 2, 2); // update GIPT
+				        	MemReq load_gipt_req = {tag * _page_lines, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
+				        	MemReq store_gipt_req = {tag * _page_lines, PUTS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
+							extAccess(load_gipt_req, 2, 2); // update GIPT
+							extAccess(store_gipt_req, 2, 2); // update GIPT
 							_ext_bw_per_step += 4;
 						} 
 					}
@@ -585,15 +744,9 @@ MemoryController::access(MemReq& req)
 			_cache[set_num].ways[replace_way].tag = tag;
          	_cache[set_num].ways[replace_way].dirty = (req.type == PUTX);
          	_tlb[tag].way = replace_way;
-			if (_scheme == UnisonCache || _scheme == Tagless) {
-				uint64_t bit = (address - tag * 64) / 4;
-				assert(bit < 16 && bit >= 0);
-				bit = ((uint64_t)1UL) << bit;
-				_tlb[tag].touch_bitvec = 0;
-				_tlb[tag].dirty_bitvec = 0;
-				_tlb[tag].touch_bitvec |= bit;
-				if (type == STORE)
-					_tlb[tag].dirty_bitvec |= bit;
+			if (_scheme == UnisonCache || _scheme == HybridCache || _scheme == Tagless) {
+				resetSectors(tag, getFrame(set_num, replace_way));
+				markSector(tag, getFrame(set_num, replace_way), address - tag * _page_lines, type == STORE);
 			}
       	} else {
 			// Miss but no replacement 
@@ -632,6 +785,7 @@ MemoryController::access(MemReq& req)
 		}
 
 
+		_src_class |= SRC_HIT;
 		if (req.type == PUTX) {
 			_numStoreHit.inc();
 			_cache[set_num].ways[hit_way].dirty = true;
@@ -650,7 +804,7 @@ MemoryController::access(MemReq& req)
 					_tag_buffer->insert(tag, false);
 			} else {
 				assert(!_sram_tag);
-	            MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+	            MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 				req.cycle = _mcdram[mcdram_select]->access(tag_probe, 0, 2);
 				_mc_bw_per_step += 2;
 				_numTagLoad.inc();
@@ -667,14 +821,17 @@ MemoryController::access(MemReq& req)
 			_mc_bw_per_step += 4;
 			req.lineAddr = address;
 			data_ready_cycle = req.cycle;
-			
-			uint64_t bit = (address - tag * 64) / 4;
-			assert(bit < 16 && bit >= 0);
-			bit = ((uint64_t)1UL) << bit;
-			_tlb[tag].touch_bitvec |= bit;
-			if (type == STORE)
-				_tlb[tag].dirty_bitvec |= bit;
 		}
+		if (_huge_page && _scheme != HMA) {
+			// first touch of a sector of a huge page, fetch it from ext dram
+			uint32_t line_idx = address - tag * _page_lines;
+			if (!isSectorTouched(tag, getFrame(set_num, hit_way), line_idx)) {
+				req.cycle = fetchSector(req, tag, line_idx, mc_address, mcdram_select, false);
+				data_ready_cycle = req.cycle;
+			}
+		}
+		if (_scheme == HybridCache || _scheme == Tagless)
+			markSector(tag, getFrame(set_num, hit_way), address - tag * _page_lines, type == STORE);
 
 		//// data access  
 		if (_scheme == HMA) {
@@ -686,16 +843,11 @@ MemoryController::access(MemReq& req)
 		}
 		if (_scheme == UnisonCache) {
 			// Update LRU information for UnisonCache
-		    MemReq tag_update_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+		    MemReq tag_update_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 			_mcdram[mcdram_select]->access(tag_update_req, 2, 2);
 			_mc_bw_per_step += 2;
 			_numTagStore.inc();
-			uint64_t bit = (address - tag * 64) / 4;
-			assert(bit < 16 && bit >= 0);
-			bit = ((uint64_t)1UL) << bit;
-			_tlb[tag].touch_bitvec |= bit;
-			if (type == STORE)
-				_tlb[tag].dirty_bitvec |= bit;
+			markSector(tag, getFrame(set_num, hit_way), address - tag * _page_lines, type == STORE);
 		}
 		///////////////////////////////
 	}
@@ -707,7 +859,7 @@ MemoryController::access(MemReq& req)
 		// One counter read and one coutner write
 		assert(set_num >= _ds_index);
 		_numCounterAccess.inc();
-        MemReq counter_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+        MemReq counter_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 		_mcdram[mcdram_select]->access(counter_req, 2, 2);
 		counter_req.type = PUTX;
 		_mcdram[mcdram_select]->access(counter_req, 2, 2);
@@ -730,10 +882,7 @@ MemoryController::access(MemReq& req)
 
 	if (_num_requests % step_length == 0)
 	{
-		_num_hit_per_step /= 2;	
-		_num_miss_per_step /= 2;
-		_mc_bw_per_step /= 2;
-		_ext_bw_per_step /= 2;
+		decayStepStats();
 		if (_bw_balance && _mc_bw_per_step + _ext_bw_per_step > 0) {
 			// adjust _ds_index	based on mc vs. ext dram bandwidth.
 			double ratio = 1.0 * _mc_bw_per_step / (_mc_bw_per_step + _ext_bw_per_step);
@@ -762,10 +911,10 @@ MemoryController::access(MemReq& req)
 							Way &meta = _cache[set].ways[way];
 							if (meta.valid && meta.dirty) {
 								// should write back to external dram. 					
-						        MemReq load_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+						        MemReq load_req = {meta.tag * _page_lines, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 								_mcdram[mc]->access(load_req, 2, (_granularity / 64)*4);
-						        MemReq wb_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-								_ext_dram->access(wb_req, 2, (_granularity / 64)*4);
+						        MemReq wb_req = {meta.tag * _page_lines, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+								extAccess(wb_req, 2, (_granularity / 64)*4);
 								_ext_bw_per_step += (_granularity / 64)*4;
 								_mc_bw_per_step += (_granularity / 64)*4;
 							}
@@ -793,7 +942,11 @@ MemoryController::access(MemReq& req)
 			printf("_ds_index = %ld/%ld\n", _ds_index, _num_sets);
 		}
 	}
+	updateWritebackBuffer(req);
+	updateSourceStats(req);
  	futex_unlock(&_lock);
+	sampleInterval(start_cycle);
+	recordSourceLatency(req, start_cycle, data_ready_cycle);
 	//uint64_t latency = req.cycle - orig_cycle;
 	//req.cycle = orig_cycle;
 	return data_ready_cycle; //req.cycle + latency;
@@ -868,6 +1021,7 @@ MemoryController::trimma_access(MemReq& req)
 	// {
 
 	// }
+	updateSourceStats(req);
 	futex_unlock(&_lock);
 	return data_ready_cycle;
 }
@@ -932,7 +1086,7 @@ MemoryController::unison_cache_access(MemReq& req)
 	ReqType type = (req.type == GETS || req.type == GETX) ? LOAD : STORE;
 	Address address = req.lineAddr;
 	 // 再次强调，此处代码`mcdram`指代的是off-chip DDR,而非本意HBM；我们考虑的系统是DDR + CXL_Memory Tiered Memory
-	uint32_t mcdram_select = (address / 64) % _mcdram_per_mc;
+	uint32_t mcdram_select = selectMcdram(address);
 	Address mc_address = (address / 64 / _mcdram_per_mc * 64) | (address % 64); 
 	Address tag = address / (_granularity / 64);
 	// 参数`_num_sets` 取决于 参数 `_cache_size`
@@ -995,12 +1149,13 @@ MemoryController::unison_cache_access(MemReq& req)
 	// }
 
 	// 替换为必须读取tag
-	MemReq tag_load = {mc_address,GETS,req.childId,&state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+	MemReq tag_load = {mc_address,GETS,req.childId,&state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 	int tag_need_burst = _num_ways * 4 / 16; 
 	if(tag_need_burst < 4)tag_need_burst = 4;
 	req.cycle = _mcdram[mcdram_select]->access(tag_load,0,tag_need_burst); // min 64B
 	int unuseful_data_size =  _num_ways*4 >= 64 ?  _num_ways*4 : 64;
 	invalid_data_size.inc(unuseful_data_size);
+	_src_class |= SRC_METADATA;
 
 	bool cache_hit = hit_way != _num_ways;
 	bool counter_access = false;
@@ -1011,6 +1166,7 @@ MemoryController::unison_cache_access(MemReq& req)
 
 		uint64_t cur_cycle = req.cycle;
 		_num_miss_per_step++;
+		_src_class |= SRC_MISS;
 		if (type == LOAD)
 			_numLoadMiss.inc();
 		else
@@ -1019,7 +1175,7 @@ MemoryController::unison_cache_access(MemReq& req)
 		uint32_t replace_way = _num_ways;
 		if (set_num >= _ds_index)
 		{	// RepScheme 0:LRU 1:FBR
-			replace_way = _page_placement_policy->handleCacheMiss(tag, type, set_num, &_cache[set_num], counter_access);
+			replace_way = placePage(req, tag, type, set_num, counter_access);
 			// 如果TLBMiss的话其实这里触发迁移策略就会进行LRU比较，产生开销
 			// if(tlb_miss)
 			// {
@@ -1033,12 +1189,12 @@ MemoryController::unison_cache_access(MemReq& req)
 
 		if(type == LOAD)
 		{
-			req.cycle = _ext_dram->cxl_access(req, 1, 4);
+			req.cycle = extAccess(req, 1, 4, true);
 			_ext_bw_per_step += 4;
 		}
 		else if(type == STORE && replace_way >= _num_ways)
 		{
-			req.cycle = _ext_dram->cxl_access(req, 1, 4); // 此处数据不写在CXL-Memory上，禁用cxl_support
+			req.cycle = extAccess(req, 1, 4, true); // 此处数据不写在CXL-Memory上，禁用cxl_support
 			_ext_bw_per_step += 4;
 		}
 		data_ready_cycle = req.cycle;
@@ -1048,35 +1204,44 @@ MemoryController::unison_cache_access(MemReq& req)
 		if (replace_way < _num_ways) // 有替换的
 		{
 			// uint32_t access_size = _granularity / 64;
-			uint32_t access_size = (_scheme == UnisonCache || _scheme == Tagless) ? _footprint_size : (_granularity / 64);
+			uint32_t access_size = (_scheme == UnisonCache || _scheme == Tagless) ? _footprint_size : _page_lines;
+			Address fill_addr = tag * _page_lines;
+			if (_huge_page)
+			{
+				// only the demanded sector of a huge page, the others are fetched on first touch
+				access_size = _leaf_lines;
+				fill_addr += (address - fill_addr) / _leaf_lines * _leaf_lines;
+			}
 			// load page from ext dram (CXL-Memory)
-			MemReq load_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-			_ext_dram->cxl_access(load_req, 2, access_size * 4);
+			MemReq load_req = {fill_addr, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+			extAccess(load_req, 2, access_size * 4, true);
 			_ext_bw_per_step += access_size * 4;
 			// store the page to mcdram
-			MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			_mcdram[mcdram_select]->access(insert_req, 2, access_size * 4); // 此处数据不写在CXL-Memory上，禁用cxl_support
 			_mc_bw_per_step += access_size * 4;
 			if(!_sram_tag)
 			{
+				insert_req.setDramClass(MemReq::DRAM_METADATA);
 				_mcdram[mcdram_select]->access(insert_req, 2, 4); // store tag (min 64)
 				_mc_bw_per_step += 2;				
 				// store tag 本质也是无效数据
 				invalid_data_size.inc(64); // datasize upd
+				_src_class |= SRC_METADATA;
 			}
 			_numTagStore.inc();
 			_numPlacement.inc();
 
 			// 没那么好认定到底是有效还是无效，因此此处定义为`migrate_data_size`
-			migrate_data_size.inc(4096-64); // datasize upd
+			migrate_data_size.inc((_huge_page? access_size * 64 : 4096) - 64); // datasize upd
 
 			if (_cache[set_num].ways[replace_way].valid) // 页粒度迁移, 脏行精确回写​​,以节省带宽
 			{
 				Address replaced_tag = _cache[set_num].ways[replace_way].tag;
 				_tlb[replaced_tag].way = _num_ways; // 本质上就是完成了清理，因为对应的是_num_ways
-				uint32_t unison_dirty_lines = __builtin_popcountll(_tlb[replaced_tag].dirty_bitvec) * 4;
-				uint32_t unison_touch_lines = __builtin_popcountll(_tlb[replaced_tag].touch_bitvec) * 4;
-				assert(unison_touch_lines > 0 && unison_touch_lines <= 64 && unison_dirty_lines <= 64);
+				uint32_t unison_dirty_lines = getDirtyLines(replaced_tag, getFrame(set_num, replace_way));
+				uint32_t unison_touch_lines = getTouchedLines(replaced_tag, getFrame(set_num, replace_way));
+				assert(unison_touch_lines > 0 && unison_touch_lines <= _page_lines && unison_dirty_lines <= _page_lines);
 				_numTouchedLines.inc(unison_touch_lines);
 				_numEvictedLines.inc(unison_dirty_lines);
 
@@ -1084,15 +1249,15 @@ MemoryController::unison_cache_access(MemReq& req)
 				{
 					_numDirtyEviction.inc();
 					assert(unison_dirty_lines > 0);
-					assert(unison_dirty_lines <= 64);
+					assert(unison_dirty_lines <= _page_lines);
 
 					// load page from mcdram
-					MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
+					MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 					_mcdram[mcdram_select]->access(load_req, 2, unison_dirty_lines * 4);
 					_mc_bw_per_step += unison_dirty_lines * 4;
 					// store page to ext dram (future cxl-memory)
-					MemReq wb_req = {_cache[set_num].ways[replace_way].tag * 64, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-					_ext_dram->cxl_access(wb_req, 2, unison_dirty_lines * 4);
+					MemReq wb_req = {_cache[set_num].ways[replace_way].tag * _page_lines, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+					extAccess(wb_req, 2, unison_dirty_lines * 4, true);
 					_ext_bw_per_step += unison_dirty_lines * 4;
 
 					// 归属于migrate
@@ -1109,14 +1274,8 @@ MemoryController::unison_cache_access(MemReq& req)
 			_cache[set_num].ways[replace_way].dirty = (req.type == PUTX);
 			_tlb[tag].way = replace_way;
 
-			uint64_t bit = (address - tag * 64) / 4;
-			assert(bit < 16 && bit >= 0);
-			bit = ((uint64_t)1UL) << bit;
-			_tlb[tag].touch_bitvec = 0;
-			_tlb[tag].dirty_bitvec = 0;
-			_tlb[tag].touch_bitvec |= bit;
-			if (type == STORE)
-					_tlb[tag].dirty_bitvec |= bit;
+			resetSectors(tag, getFrame(set_num, replace_way));
+			markSector(tag, getFrame(set_num, replace_way), address - tag * _page_lines, type == STORE);
 		}
 		else
 		{
@@ -1128,6 +1287,7 @@ MemoryController::unison_cache_access(MemReq& req)
 	{
 		_numTotalHit.inc(); // hitmiss upd
 		invalid_data_size.inc(4); // datasize upd 无论如何也是读了一个tag
+		_src_class |= SRC_METADATA;
 		assert(set_num >= _ds_index);
 		// LLC dirty eviction hit
 		if(type == STORE)
@@ -1136,12 +1296,20 @@ MemoryController::unison_cache_access(MemReq& req)
 			req.cycle = _mcdram[mcdram_select]->access(write_req, 1, 4);
 			_mc_bw_per_step += 4;
 		}
+		if (_huge_page)
+		{
+			// first touch of a sector of a huge page, fetch it from ext dram
+			uint32_t line_idx = address - tag * _page_lines;
+			if (!isSectorTouched(tag, getFrame(set_num, hit_way), line_idx))
+				req.cycle = fetchSector(req, tag, line_idx, mc_address, mcdram_select, true);
+		}
 		
 		data_ready_cycle = req.cycle;
 		_num_hit_per_step++;
 		_page_placement_policy->handleCacheHit(tag, type, set_num, &_cache[set_num], counter_access, hit_way);
 		valid_data_size.inc(64); // datasize upd
 
+		_src_class |= SRC_HIT;
 		if (req.type == PUTX)
 		{
 			_numStoreHit.inc();
@@ -1152,25 +1320,21 @@ MemoryController::unison_cache_access(MemReq& req)
 		// _numTotalHit.inc(); // 上面已经写了
 
 		// Update LRU information for UnisonCache
-		MemReq tag_update_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+		MemReq tag_update_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 		_mcdram[mcdram_select]->access(tag_update_req, 2, 2);
 		_mc_bw_per_step += 2;
 		_numTagStore.inc();
-		uint64_t bit = (address - tag * 64) / 4;
-		assert(bit < 16 && bit >= 0);
-		bit = ((uint64_t)1UL) << bit;
-		_tlb[tag].touch_bitvec |= bit;
-		if (type == STORE)
-				_tlb[tag].dirty_bitvec |= bit;
+		markSector(tag, getFrame(set_num, hit_way), address - tag * _page_lines, type == STORE);
 		
 		policy_update_size.inc(4); // datasize upd
+		_src_class |= SRC_METADATA;
 	}
 
 	if(counter_access && !_sram_tag)
 	{
 		assert(set_num >= _ds_index);
 		_numCounterAccess.inc();
-		MemReq counter_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+		MemReq counter_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 		_mcdram[mcdram_select]->access(counter_req, 2, 2);
 		counter_req.type = PUTX;
 		_mcdram[mcdram_select]->access(counter_req, 2, 2);
@@ -1179,10 +1343,7 @@ MemoryController::unison_cache_access(MemReq& req)
 
 	if (_num_requests % step_length == 0)
 	{
-		_num_hit_per_step /= 2;
-		_num_miss_per_step /= 2;
-		_mc_bw_per_step /= 2;
-		_ext_bw_per_step /= 2;
+		decayStepStats();
 		//默认不开启
 		if (_bw_balance && _mc_bw_per_step + _ext_bw_per_step > 0)
 		{
@@ -1204,10 +1365,10 @@ MemoryController::unison_cache_access(MemReq& req)
 							if (meta.valid && meta.dirty)
 							{
 								// should write back to external dram.
-								MemReq load_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+								MemReq load_req = {meta.tag * _page_lines, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 								_mcdram[mc]->access(load_req, 2, (_granularity / 64) * 4);
-								MemReq wb_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-								_ext_dram->cxl_access(wb_req, 2, (_granularity / 64) * 4);
+								MemReq wb_req = {meta.tag * _page_lines, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+								extAccess(wb_req, 2, (_granularity / 64) * 4, true);
 								_ext_bw_per_step += (_granularity / 64) * 4;
 								_mc_bw_per_step += (_granularity / 64) * 4;
 							}
@@ -1236,6 +1397,7 @@ MemoryController::unison_cache_access(MemReq& req)
 			_ds_index = ((int64_t)_ds_index + delta_index <= 0) ? 0 : _ds_index + delta_index;
 		}
 	}
+	updateSourceStats(req);
 	futex_unlock(&_lock);
 	return data_ready_cycle;
 }
@@ -1291,7 +1453,7 @@ MemoryController::ideal_unison_access(MemReq& req)
 	ReqType type = (req.type == GETS || req.type == GETX) ? LOAD : STORE;
 	Address address = req.lineAddr;
 	 // 再次强调，此处代码`mcdram`指代的是off-chip DDR,而非本意HBM；我们考虑的系统是DDR + CXL_Memory Tiered Memory
-	uint32_t mcdram_select = (address / 64) % _mcdram_per_mc;
+	uint32_t mcdram_select = selectMcdram(address);
 	Address mc_address = (address / 64 / _mcdram_per_mc * 64) | (address % 64); 
 	Address tag = address / (_granularity / 64);
 	// 参数`_num_sets` 取决于 参数 `_cache_size`
@@ -1339,7 +1501,9 @@ MemoryController::ideal_unison_access(MemReq& req)
 	if (type == LOAD)
 	{
 		req.lineAddr = mc_address; // transMCAddressPage(set_num, 0); //mc_address;
+		req.setDramClass(MemReq::DRAM_METADATA); // tag read
 		req.cycle = _mcdram[mcdram_select]->access(req, 0, 2); // 此处数据不存在CXL-Memory上，禁用cxl_support
+		req.setDramClass(MemReq::DRAM_DEMAND);
 		_mc_bw_per_step += 6;
 		_numTagLoad.inc();
 		req.lineAddr = address; 
@@ -1347,7 +1511,7 @@ MemoryController::ideal_unison_access(MemReq& req)
 	else
 	{
 		assert(type == STORE);
-		MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+		MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 		req.cycle = _mcdram[mcdram_select]->access(tag_probe, 0, 2); // 此处数据不存在CXL-Memory上，禁用cxl_support
 		_mc_bw_per_step += 2;
 		_numTagLoad.inc();
@@ -1363,6 +1527,7 @@ MemoryController::ideal_unison_access(MemReq& req)
 
 		uint64_t cur_cycle = req.cycle;
 		_num_miss_per_step++;
+		_src_class |= SRC_MISS;
 		if (type == LOAD)
 			_numLoadMiss.inc();
 		else
@@ -1371,7 +1536,7 @@ MemoryController::ideal_unison_access(MemReq& req)
 		uint32_t replace_way = _num_ways;
 		if (set_num >= _ds_index)
 		{	// RepScheme 0:LRU 1:FBR
-			replace_way = _page_placement_policy->handleCacheMiss(tag, type, set_num, &_cache[set_num], counter_access);
+			replace_way = placePage(req, tag, type, set_num, counter_access);
 			// 如果TLBMiss的话其实这里触发迁移策略就会进行LRU比较，产生开销
 			// if(tlb_miss)
 			// {
@@ -1385,12 +1550,12 @@ MemoryController::ideal_unison_access(MemReq& req)
 
 		if(type == LOAD)
 		{
-			req.cycle = _ext_dram->cxl_access(req, 1, 4);
+			req.cycle = extAccess(req, 1, 4, true);
 			_ext_bw_per_step += 4;
 		}
 		else if(type == STORE && replace_way >= _num_ways)
 		{
-			req.cycle = _ext_dram->cxl_access(req, 1, 4); // 此处数据不写在CXL-Memory上，禁用cxl_support
+			req.cycle = extAccess(req, 1, 4, true); // 此处数据不写在CXL-Memory上，禁用cxl_support
 			_ext_bw_per_step += 4;
 		}
 		data_ready_cycle = req.cycle;
@@ -1400,13 +1565,20 @@ MemoryController::ideal_unison_access(MemReq& req)
 		if (replace_way < _num_ways) // 有替换的
 		{
 			// uint32_t access_size = _granularity / 64;
-			uint32_t access_size = (_scheme == UnisonCache || _scheme == Tagless) ? _footprint_size : (_granularity / 64);
+			uint32_t access_size = (_scheme == UnisonCache || _scheme == Tagless) ? _footprint_size : _page_lines;
+			Address fill_addr = tag * _page_lines;
+			if (_huge_page)
+			{
+				// only the demanded sector of a huge page, the others are fetched on first touch
+				access_size = _leaf_lines;
+				fill_addr += (address - fill_addr) / _leaf_lines * _leaf_lines;
+			}
 			// load page from ext dram (CXL-Memory)
-			MemReq load_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-			_ext_dram->cxl_access(load_req, 2, access_size * 4);
+			MemReq load_req = {fill_addr, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+			extAccess(load_req, 2, access_size * 4, true);
 			_ext_bw_per_step += access_size * 4;
 			// store the page to mcdram
-			MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			_mcdram[mcdram_select]->access(insert_req, 2, access_size * 4); // 此处数据不写在CXL-Memory上，禁用cxl_support
 			_mc_bw_per_step += access_size * 4;
 			// if(!_sram_tag)
@@ -1420,15 +1592,15 @@ MemoryController::ideal_unison_access(MemReq& req)
 			_numPlacement.inc();
 
 			// 没那么好认定到底是有效还是无效，因此此处定义为`migrate_data_size`
-			migrate_data_size.inc(4096-64); // datasize upd
+			migrate_data_size.inc((_huge_page? access_size * 64 : 4096) - 64); // datasize upd
 
 			if (_cache[set_num].ways[replace_way].valid) // 页粒度迁移, 脏行精确回写​​,以节省带宽
 			{
 				Address replaced_tag = _cache[set_num].ways[replace_way].tag;
 				_tlb[replaced_tag].way = _num_ways; // 本质上就是完成了清理，因为对应的是_num_ways
-				uint32_t unison_dirty_lines = __builtin_popcountll(_tlb[replaced_tag].dirty_bitvec) * 4;
-				uint32_t unison_touch_lines = __builtin_popcountll(_tlb[replaced_tag].touch_bitvec) * 4;
-				assert(unison_touch_lines > 0 && unison_touch_lines <= 64 && unison_dirty_lines <= 64);
+				uint32_t unison_dirty_lines = getDirtyLines(replaced_tag, getFrame(set_num, replace_way));
+				uint32_t unison_touch_lines = getTouchedLines(replaced_tag, getFrame(set_num, replace_way));
+				assert(unison_touch_lines > 0 && unison_touch_lines <= _page_lines && unison_dirty_lines <= _page_lines);
 				_numTouchedLines.inc(unison_touch_lines);
 				_numEvictedLines.inc(unison_dirty_lines);
 
@@ -1436,15 +1608,15 @@ MemoryController::ideal_unison_access(MemReq& req)
 				{
 					_numDirtyEviction.inc();
 					assert(unison_dirty_lines > 0);
-					assert(unison_dirty_lines <= 64);
+					assert(unison_dirty_lines <= _page_lines);
 
 					// load page from mcdram
-					MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
+					MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 					_mcdram[mcdram_select]->access(load_req, 2, unison_dirty_lines * 4);
 					_mc_bw_per_step += unison_dirty_lines * 4;
 					// store page to ext dram (future cxl-memory)
-					MemReq wb_req = {_cache[set_num].ways[replace_way].tag * 64, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-					_ext_dram->cxl_access(wb_req, 2, unison_dirty_lines * 4);
+					MemReq wb_req = {_cache[set_num].ways[replace_way].tag * _page_lines, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+					extAccess(wb_req, 2, unison_dirty_lines * 4, true);
 					_ext_bw_per_step += unison_dirty_lines * 4;
 
 					// 归属于migrate
@@ -1461,14 +1633,8 @@ MemoryController::ideal_unison_access(MemReq& req)
 			_cache[set_num].ways[replace_way].dirty = (req.type == PUTX);
 			_tlb[tag].way = replace_way;
 
-			uint64_t bit = (address - tag * 64) / 4;
-			assert(bit < 16 && bit >= 0);
-			bit = ((uint64_t)1UL) << bit;
-			_tlb[tag].touch_bitvec = 0;
-			_tlb[tag].dirty_bitvec = 0;
-			_tlb[tag].touch_bitvec |= bit;
-			if (type == STORE)
-					_tlb[tag].dirty_bitvec |= bit;
+			resetSectors(tag, getFrame(set_num, replace_way));
+			markSector(tag, getFrame(set_num, replace_way), address - tag * _page_lines, type == STORE);
 		}
 		else
 		{
@@ -1480,6 +1646,7 @@ MemoryController::ideal_unison_access(MemReq& req)
 	{
 		_numTotalHit.inc(); // hitmiss upd
 		invalid_data_size.inc(4); // datasize upd 无论如何也是读了一个tag
+		_src_class |= SRC_METADATA;
 		assert(set_num >= _ds_index);
 		// LLC dirty eviction hit
 		if(type == STORE)
@@ -1488,12 +1655,20 @@ MemoryController::ideal_unison_access(MemReq& req)
 			req.cycle = _mcdram[mcdram_select]->access(write_req, 1, 4);
 			_mc_bw_per_step += 4;
 		}
+		if (_huge_page)
+		{
+			// first touch of a sector of a huge page, fetch it from ext dram
+			uint32_t line_idx = address - tag * _page_lines;
+			if (!isSectorTouched(tag, getFrame(set_num, hit_way), line_idx))
+				req.cycle = fetchSector(req, tag, line_idx, mc_address, mcdram_select, true);
+		}
 		
 		data_ready_cycle = req.cycle;
 		_num_hit_per_step++;
 		_page_placement_policy->handleCacheHit(tag, type, set_num, &_cache[set_num], counter_access, hit_way);
 		valid_data_size.inc(64); // datasize upd
 
+		_src_class |= SRC_HIT;
 		if (req.type == PUTX)
 		{
 			_numStoreHit.inc();
@@ -1508,21 +1683,17 @@ MemoryController::ideal_unison_access(MemReq& req)
 		// _mcdram[mcdram_select]->access(tag_update_req, 2, 2);
 		_mc_bw_per_step += 2;
 		_numTagStore.inc();
-		uint64_t bit = (address - tag * 64) / 4;
-		assert(bit < 16 && bit >= 0);
-		bit = ((uint64_t)1UL) << bit;
-		_tlb[tag].touch_bitvec |= bit;
-		if (type == STORE)
-				_tlb[tag].dirty_bitvec |= bit;
+		markSector(tag, getFrame(set_num, hit_way), address - tag * _page_lines, type == STORE);
 		
 		policy_update_size.inc(4); // datasize upd
+		_src_class |= SRC_METADATA;
 	}
 
 	if(counter_access && !_sram_tag)
 	{
 		assert(set_num >= _ds_index);
 		_numCounterAccess.inc();
-		MemReq counter_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+		MemReq counter_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 		_mcdram[mcdram_select]->access(counter_req, 2, 2);
 		counter_req.type = PUTX;
 		_mcdram[mcdram_select]->access(counter_req, 2, 2);
@@ -1531,10 +1702,7 @@ MemoryController::ideal_unison_access(MemReq& req)
 
 	if (_num_requests % step_length == 0)
 	{
-		_num_hit_per_step /= 2;
-		_num_miss_per_step /= 2;
-		_mc_bw_per_step /= 2;
-		_ext_bw_per_step /= 2;
+		decayStepStats();
 		//默认不开启
 		if (_bw_balance && _mc_bw_per_step + _ext_bw_per_step > 0)
 		{
@@ -1556,10 +1724,10 @@ MemoryController::ideal_unison_access(MemReq& req)
 							if (meta.valid && meta.dirty)
 							{
 								// should write back to external dram.
-								MemReq load_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+								MemReq load_req = {meta.tag * _page_lines, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 								_mcdram[mc]->access(load_req, 2, (_granularity / 64) * 4);
-								MemReq wb_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-								_ext_dram->cxl_access(wb_req, 2, (_granularity / 64) * 4);
+								MemReq wb_req = {meta.tag * _page_lines, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+								extAccess(wb_req, 2, (_granularity / 64) * 4, true);
 								_ext_bw_per_step += (_granularity / 64) * 4;
 								_mc_bw_per_step += (_granularity / 64) * 4;
 							}
@@ -1588,6 +1756,7 @@ MemoryController::ideal_unison_access(MemReq& req)
 			_ds_index = ((int64_t)_ds_index + delta_index <= 0) ? 0 : _ds_index + delta_index;
 		}
 	}
+	updateSourceStats(req);
 	futex_unlock(&_lock);
 	return data_ready_cycle;
 }
@@ -1643,7 +1812,7 @@ MemoryController::basic_cache_access(MemReq& req)
 	ReqType type = (req.type == GETS || req.type == GETX) ? LOAD : STORE;
 	Address address = req.lineAddr;
 	// 再次强调，此处代码`mcdram`指代的是off-chip DDR,而非本意HBM；我们考虑的系统是DDR + CXL_Memory Tiered Memory
-	uint32_t mcdram_select = (address / 64) % _mcdram_per_mc;
+	uint32_t mcdram_select = selectMcdram(address);
 	Address mc_address = (address / 64 / _mcdram_per_mc * 64) | (address % 64); 
 	uint32_t cacheline_offset = address * 64 % (4*1024) / 64; // add by jh
 	Address tag = address / (_granularity / 64);
@@ -1686,9 +1855,10 @@ MemoryController::basic_cache_access(MemReq& req)
 	{
 		// fetch unuseful data
 		invalid_data_size.inc(_num_ways*4);
+		_src_class |= SRC_METADATA;
 
 		// access(load) tags
-		MemReq load_req = {mc_address, GETX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+		MemReq load_req = {mc_address, GETX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 		int data_burst_size = _num_ways * 4 / 16;
 		if(data_burst_size % 2 != 0) data_burst_size =  data_burst_size*2;
 		if(data_burst_size == 0) data_burst_size = 2;
@@ -1738,10 +1908,10 @@ MemoryController::basic_cache_access(MemReq& req)
 			// load and store
 			MemReq cxl_load_req = {req.lineAddr, GETX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
 			
-			if(init_state == 0)req.cycle = _ext_dram->access(cxl_load_req,init_state,4);
-			else req.cycle = _ext_dram->access(cxl_load_req,init_state,4);
+			if(init_state == 0)req.cycle = extAccess(cxl_load_req,init_state,4);
+			else req.cycle = extAccess(cxl_load_req,init_state,4);
 
-			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			if(init_state == 0)req.cycle = _mcdram[mcdram_select]->access(ddr_store_req,init_state+1,4);
 			else _mcdram[mcdram_select]->access(ddr_store_req,init_state+1,4);
 
@@ -1758,10 +1928,10 @@ MemoryController::basic_cache_access(MemReq& req)
 		{
 			// load and store
 			MemReq cxl_load_req = {req.lineAddr, GETX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-			if(init_state==0)req.cycle = _ext_dram->access(cxl_load_req,init_state,4);
-			else req.cycle = _ext_dram->access(cxl_load_req,init_state,4);
+			if(init_state==0)req.cycle = extAccess(cxl_load_req,init_state,4);
+			else req.cycle = extAccess(cxl_load_req,init_state,4);
 
-			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			_mcdram[mcdram_select]->access(ddr_store_req,init_state+1,4);
 			way_find_idx = _cache[set_num].getEmptyWay();
 			_cache[set_num].ways[_cache[set_num].getEmptyWay()].valid = true;
@@ -1782,7 +1952,7 @@ MemoryController::basic_cache_access(MemReq& req)
 				if(_cache[set_num].ways[lru_way].dirty_vector[i]==true)num_cacheline_evict += 1;
 			}
 			
-			MemReq ddr_evict_req = {req.lineAddr, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			MemReq ddr_evict_req = {req.lineAddr, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			if(init_state == 0)req.cycle = _mcdram[mcdram_select]->access(ddr_evict_req,init_state,4*num_cacheline_evict);
 			else req.cycle = _mcdram[mcdram_select]->access(ddr_evict_req,init_state,4*num_cacheline_evict);
 
@@ -1794,9 +1964,9 @@ MemoryController::basic_cache_access(MemReq& req)
 
 			// load store
 			MemReq cxl_load_req = {req.lineAddr, GETX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-			if(init_state==0)req.cycle =_ext_dram->access(cxl_load_req,init_state+1,4);
-			else _ext_dram->access(cxl_load_req,init_state+1,4);
-			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			if(init_state==0)req.cycle =extAccess(cxl_load_req,init_state+1,4);
+			else extAccess(cxl_load_req,init_state+1,4);
+			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			_mcdram[mcdram_select]->access(ddr_store_req,2,4);
 
 			_cache[set_num].ways[lru_way].valid_vector[cacheline_offset] = true;
@@ -1819,6 +1989,7 @@ MemoryController::basic_cache_access(MemReq& req)
 		_basic_tag_buffer[0].third = way_find_idx;
 	}
 
+	updateSourceStats(req);
 	futex_unlock(&_lock);
 	return req.cycle;
 }
@@ -1872,7 +2043,7 @@ MemoryController::theoretical_basic_cache_access(MemReq& req)
 	ReqType type = (req.type == GETS || req.type == GETX) ? LOAD : STORE;
 	Address address = req.lineAddr;
 	// 再次强调，此处代码`mcdram`指代的是off-chip DDR,而非本意HBM；我们考虑的系统是DDR + CXL_Memory Tiered Memory
-	uint32_t mcdram_select = (address / 64) % _mcdram_per_mc;
+	uint32_t mcdram_select = selectMcdram(address);
 	Address mc_address = (address / 64 / _mcdram_per_mc * 64) | (address % 64); 
 	uint32_t cacheline_offset = address * 64 % (4*1024) / 64; // add by jh
 	Address tag = address / (_granularity / 64);
@@ -1951,9 +2122,9 @@ MemoryController::theoretical_basic_cache_access(MemReq& req)
 			// load and store
 			MemReq cxl_load_req = {req.lineAddr, GETX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
 			
-			req.cycle = _ext_dram->access(cxl_load_req,0,4);
+			req.cycle = extAccess(cxl_load_req,0,4);
 
-			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			req.cycle = _mcdram[mcdram_select]->access(ddr_store_req,1,4);
 
 			_cache[set_num].ways[way_find_idx].valid = true; // 无效代码
@@ -1970,9 +2141,9 @@ MemoryController::theoretical_basic_cache_access(MemReq& req)
 		{
 			// load and store
 			MemReq cxl_load_req = {req.lineAddr, GETX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-			req.cycle = _ext_dram->access(cxl_load_req,0,4);
+			req.cycle = extAccess(cxl_load_req,0,4);
 
-			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			req.cycle = _mcdram[mcdram_select]->access(ddr_store_req,1,4);
 			way_find_idx = _cache[set_num].getEmptyWay();
 			_cache[set_num].ways[_cache[set_num].getEmptyWay()].valid = true;
@@ -1994,7 +2165,7 @@ MemoryController::theoretical_basic_cache_access(MemReq& req)
 			// std::cout << "4*num_cacheline_evict = " << 4*num_cacheline_evict <<std::endl;
 			// Evict
 
-			MemReq ddr_evict_req = {req.lineAddr, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			MemReq ddr_evict_req = {req.lineAddr, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			req.cycle = _mcdram[mcdram_select]->access(ddr_evict_req,0,4*num_cacheline_evict);
 
 			
@@ -2005,8 +2176,8 @@ MemoryController::theoretical_basic_cache_access(MemReq& req)
 
 			// load store
 			MemReq cxl_load_req = {req.lineAddr, GETX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-			req.cycle = _ext_dram->access(cxl_load_req,1,4);
-			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			req.cycle = extAccess(cxl_load_req,1,4);
+			MemReq ddr_store_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			_mcdram[mcdram_select]->access(ddr_store_req,2,4);
 
 			_cache[set_num].ways[lru_way].valid_vector[cacheline_offset] = true;
@@ -2027,6 +2198,7 @@ MemoryController::theoretical_basic_cache_access(MemReq& req)
 		_basic_tag_buffer[0].second = tag;
 		_basic_tag_buffer[0].third = way_find_idx;
 	}
+	updateSourceStats(req);
 	futex_unlock(&_lock);
 	return req.cycle;
 }
@@ -2075,7 +2247,7 @@ MemoryController::test_cache_access(MemReq& req)
 
 	ReqType type = (req.type == GETS || req.type == GETX) ? LOAD : STORE;
 	Address address = req.lineAddr;
-	uint32_t mcdram_select = (address / 64) % _mcdram_per_mc;
+	uint32_t mcdram_select = selectMcdram(address);
 	Address mc_address = (address / 64 / _mcdram_per_mc * 64) | (address % 64); 
 	// uint32_t cacheline_offset = address * 64 % (4*1024) / 64; // add by jh
 	Address tag = address / (_granularity / 64);
@@ -2083,6 +2255,10 @@ MemoryController::test_cache_access(MemReq& req)
 	uint64_t set_num = tag % _num_sets;
 	uint64_t data_ready_cycle = req.cycle;
 	MESIState state;
+	// Line within the page, and the sector (of sector_lines lines) holding it
+	uint32_t line_idx = address - tag * _page_lines;
+	uint32_t sector_lines = _sector_size / 64;
+	Address sector_addr = tag * _page_lines + line_idx / sector_lines * sector_lines;
 
 	// 这一段代码需要确认是否需要删除
 	if (_tlb.find(tag) == _tlb.end())
@@ -2095,12 +2271,14 @@ MemoryController::test_cache_access(MemReq& req)
 
 	// 读取多个tags(tag的地址怎么说？)
 	// Shared
-	MemReq tag_load = {mc_address,GETS,req.childId,&state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+	MemReq tag_load = {mc_address,GETS,req.childId,&state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 	int tag_need_burst = _num_ways * 4 / 16; 
 	if(tag_need_burst < 4)tag_need_burst = 4;
 	req.cycle = _mcdram[mcdram_select]->access(tag_load,0,tag_need_burst); // min 64B
+	_mc_bw_per_step += tag_need_burst;
 	int unuseful_data_size =  _num_ways*4 >= 64 ?  _num_ways*4 : 64;
 	invalid_data_size.inc(unuseful_data_size);
+	_src_class |= SRC_METADATA;
 
 	bool cache_hit = hit_way != _num_ways;
 	
@@ -2108,6 +2286,7 @@ MemoryController::test_cache_access(MemReq& req)
 	if(!cache_hit)
 	{
 		uint64_t cur_cycle = req.cycle;
+		_src_class |= SRC_MISS;
 		if (type == LOAD)
 			_numLoadMiss.inc();
 		else
@@ -2115,50 +2294,55 @@ MemoryController::test_cache_access(MemReq& req)
 
 		uint32_t replace_way = _num_ways;
 		if (set_num >= _ds_index)
-			replace_way = _page_placement_policy->handleCacheMiss(tag, type, set_num, &_cache[set_num], counter_access);
+			replace_way = placePage(req, tag, type, set_num, counter_access);
 
 		// load from external memory (cxl-ddr/cxl-nvm)
 		if (type == LOAD)
 		{
-			req.cycle = _ext_dram->cxl_access(req, 1, 4);
+			req.cycle = extAccess(req, 1, 4, true);
+			_ext_bw_per_step += 4;
 		}
 		else if(type == STORE && replace_way >= _num_ways)
 		{
-			req.cycle = _ext_dram->cxl_access(req, 1, 4);
+			req.cycle = extAccess(req, 1, 4, true);
+			_ext_bw_per_step += 4;
 		}
 		data_ready_cycle = req.cycle;
 
 		if (replace_way < _num_ways)
 		{
-			uint32_t access_size = 64;
+			// whole page by default, only the demanded sector in sectored mode
+			uint32_t access_size = sector_lines;
 			// load page from ext dram(cxl-dram/cxl-nvm)
-			MemReq load_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-			_ext_dram->cxl_access(load_req, 2, access_size * 4);
+			MemReq load_req = {sector_addr, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+			extAccess(load_req, 2, access_size * 4, true);
+			_ext_bw_per_step += access_size * 4;
 			// store the page to mcdram
-			MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			_mcdram[mcdram_select]->access(insert_req, 2, access_size * 4);
+			_mc_bw_per_step += access_size * 4;
 			// store tag
 			invalid_data_size.inc(64);
+			_src_class |= SRC_METADATA;
+			insert_req.setDramClass(MemReq::DRAM_METADATA);
 			_mcdram[mcdram_select]->access(insert_req, 2, 4); // Read-Modify-Write, min 64B too
+			_mc_bw_per_step += 4;
 			_numTagStore.inc();
 
 			_numPlacement.inc();
 			if (_cache[set_num].ways[replace_way].valid)
 			{
 				Address replaced_tag = _cache[set_num].ways[replace_way].tag;
+				_numSectorWastedBytes.inc(getUntouchedLines(_cache[set_num].ways[replace_way]) * 64);
 				_tlb[replaced_tag].way = _num_ways;
-				uint32_t dirty_lines = __builtin_popcountll(_tlb[replaced_tag].dirty_bitvec) * 4;
-				uint32_t touch_lines = __builtin_popcountll(_tlb[replaced_tag].touch_bitvec) * 4;
+				uint32_t dirty_lines = getDirtyLines(replaced_tag, getFrame(set_num, replace_way));
+				uint32_t touch_lines = getTouchedLines(replaced_tag, getFrame(set_num, replace_way));
 				// used for evitc cacheline
 				if (_cache[set_num].ways[replace_way].dirty)
 				{
 					_numDirtyEviction.inc();
-					assert(dirty_lines > 0 && touch_lines <= 64);
-					MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-					_mcdram[mcdram_select]->access(load_req, 2, dirty_lines * 4);
-
-					MemReq wb_req = {_cache[set_num].ways[replace_way].tag * 64, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-					_ext_dram->cxl_access(wb_req, 2, dirty_lines * 4);
+					assert(dirty_lines > 0 && touch_lines <= _page_lines);
+					writebackDirtySectors(req, replaced_tag, getFrame(set_num, replace_way), mc_address, mcdram_select, true, cur_cycle);
 				}
 				else
 				{
@@ -2171,15 +2355,12 @@ MemoryController::test_cache_access(MemReq& req)
 			_cache[set_num].ways[replace_way].tag = tag;
 			_cache[set_num].ways[replace_way].dirty = (req.type == PUTX);
 			_tlb[tag].way = replace_way;
+			_cache[set_num].ways[replace_way].cleanVector();
+			fillSector(_cache[set_num].ways[replace_way], line_idx, sector_lines);
+			touchLine(_cache[set_num].ways[replace_way], line_idx);
 
-			uint64_t bit = (address - tag * 64) / 4;
-			assert(bit < 16 && bit >= 0);
-			bit = ((uint64_t)1UL) << bit;
-			_tlb[tag].touch_bitvec = 0;
-			_tlb[tag].dirty_bitvec = 0;
-			_tlb[tag].touch_bitvec |= bit;
-			if (type == STORE)
-				_tlb[tag].dirty_bitvec |= bit;
+			resetSectors(tag, getFrame(set_num, replace_way));
+			markSector(tag, getFrame(set_num, replace_way), address - tag * _page_lines, type == STORE);
 		}
 		else
 		{
@@ -2189,29 +2370,55 @@ MemoryController::test_cache_access(MemReq& req)
 	else // cache_hit == true
 	{
 		assert(set_num >= _ds_index);
-		// LLC dirty eviction hit
-		MemReq write_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-		req.cycle = _mcdram[mcdram_select]->access(write_req, 1, 4);
-		data_ready_cycle = req.cycle;
-		if (req.type == PUTX)
+		Way& way = _cache[set_num].ways[hit_way];
+		// A full-line store into an invalid single-line sector needs no fetch
+		if (!way.valid_vector[line_idx] && type == STORE && sector_lines == 1)
+			fillSector(way, line_idx, sector_lines, false);
+		if (!way.valid_vector[line_idx])
 		{
-			_numStoreHit.inc();
-			_cache[set_num].ways[hit_way].dirty = true;
+			// Tag hit, sector miss: fetch the sector from ext dram, then fill it into mcdram
+			_numSectorFill.inc();
+			_src_class |= SRC_MISS;
+			if (type == LOAD)
+				_numLoadMiss.inc();
+			else
+				_numStoreMiss.inc();
+			MemReq fill_req = {sector_addr, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			req.cycle = extAccess(fill_req, 1, sector_lines * 4, true);
+			_ext_bw_per_step += sector_lines * 4;
+			MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+			_mcdram[mcdram_select]->access(insert_req, 2, sector_lines * 4);
+			_mc_bw_per_step += sector_lines * 4;
+			fillSector(way, line_idx, sector_lines);
 		}
 		else
-			_numLoadHit.inc();
+		{
+			// LLC dirty eviction hit
+			MemReq write_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			req.cycle = _mcdram[mcdram_select]->access(write_req, 1, 4);
+			_mc_bw_per_step += 4;
+			_src_class |= SRC_HIT;
+			if (req.type == PUTX)
+				_numStoreHit.inc();
+			else
+				_numLoadHit.inc();
+		}
+		data_ready_cycle = req.cycle;
+		if (req.type == PUTX)
+			way.dirty = true;
+		touchLine(way, line_idx);
+		// Basic keeps insertion-order LRU; PRR samples its counter on hits
+		if (_page_placement_policy->get_placement_policy() == PagePlacementPolicy::PRR)
+			_page_placement_policy->handleCacheHit(tag, type, set_num, &_cache[set_num], counter_access, hit_way);
 
 		// Update LRU information
-		MemReq tag_update_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+		MemReq tag_update_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 		_mcdram[mcdram_select]->access(tag_update_req, 2, 4); // min 64B
+		_mc_bw_per_step += 4;
 		invalid_data_size.inc(64); // update metadata
+		_src_class |= SRC_METADATA;
 		_numTagStore.inc();
-		uint64_t bit = (address - tag * 64) / 4;
-		assert(bit < 16 && bit >= 0);
-		bit = ((uint64_t)1UL) << bit;
-		_tlb[tag].touch_bitvec |= bit;
-		if (type == STORE)
-			_tlb[tag].dirty_bitvec |= bit;
+		markSector(tag, getFrame(set_num, hit_way), address - tag * _page_lines, type == STORE);
 	}
 	// if (counter_access)
 	// {
@@ -2226,6 +2433,8 @@ MemoryController::test_cache_access(MemReq& req)
 	// 	_mcdram[mcdram_select]->access(counter_req, 2, 2);
 	// 	_mc_bw_per_step += 4;
 	// }
+	updateWritebackBuffer(req);
+	updateSourceStats(req);
 	futex_unlock(&_lock);
 	return data_ready_cycle;
 }
@@ -2274,7 +2483,7 @@ MemoryController::ideal_cache_access(MemReq& req)
 
 	ReqType type = (req.type == GETS || req.type == GETX) ? LOAD : STORE;
 	Address address = req.lineAddr;
-	uint32_t mcdram_select = (address / 64) % _mcdram_per_mc;
+	uint32_t mcdram_select = selectMcdram(address);
 	Address mc_address = (address / 64 / _mcdram_per_mc * 64) | (address % 64); 
 	// uint32_t cacheline_offset = address * 64 % (4*1024) / 64; // add by jh
 	Address tag = address / (_granularity / 64);
@@ -2301,6 +2510,7 @@ MemoryController::ideal_cache_access(MemReq& req)
 	req.cycle += 0;
 	int unuseful_data_size =  _num_ways*4 >= 64 ?  _num_ways*4 : 64;
 	invalid_data_size.inc(unuseful_data_size);
+	_src_class |= SRC_METADATA;
 
 	bool cache_hit = hit_way != _num_ways;
 	
@@ -2308,6 +2518,7 @@ MemoryController::ideal_cache_access(MemReq& req)
 	if(!cache_hit)
 	{
 		uint64_t cur_cycle = req.cycle;
+		_src_class |= SRC_MISS;
 		if (type == LOAD)
 			_numLoadMiss.inc();
 		else
@@ -2315,31 +2526,36 @@ MemoryController::ideal_cache_access(MemReq& req)
 
 		uint32_t replace_way = _num_ways;
 		if (set_num >= _ds_index)
-			replace_way = _page_placement_policy->handleCacheMiss(tag, type, set_num, &_cache[set_num], counter_access);
+			replace_way = placePage(req, tag, type, set_num, counter_access);
 
 		// load from external memory (cxl-ddr/cxl-nvm)
 		if (type == LOAD)
 		{
-			req.cycle = _ext_dram->cxl_access(req, 0, 4);
+			req.cycle = extAccess(req, 0, 4, true);
+			_ext_bw_per_step += 4;
 		}
 		else if(type == STORE && replace_way >= _num_ways)
 		{
-			req.cycle = _ext_dram->cxl_access(req, 0, 4);
+			req.cycle = extAccess(req, 0, 4, true);
+			_ext_bw_per_step += 4;
 		}
-		else req.cycle = _ext_dram->access(req, 0, 0); //防止Bug
+		else req.cycle = extAccess(req, 0, 0); //防止Bug
 		data_ready_cycle = req.cycle;
 
 		if (replace_way < _num_ways)
 		{
 			uint32_t access_size = 64;
 			// load page from ext dram(cxl-dram/cxl-nvm)
-			MemReq load_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-			_ext_dram->cxl_access(load_req, 2, access_size * 4);
+			MemReq load_req = {tag * _page_lines, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+			extAccess(load_req, 2, access_size * 4, true);
+			_ext_bw_per_step += access_size * 4;
 			// store the page to mcdram
-			MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
 			_mcdram[mcdram_select]->access(insert_req, 2, access_size * 4);
+			_mc_bw_per_step += access_size * 4;
 			// store tag
 			invalid_data_size.inc(64);
+			_src_class |= SRC_METADATA;
 			// _mcdram[mcdram_select]->access(insert_req, 2, 4); // Read-Modify-Write, min 64B too **delete**
 			_numTagStore.inc();
 
@@ -2348,18 +2564,14 @@ MemoryController::ideal_cache_access(MemReq& req)
 			{
 				Address replaced_tag = _cache[set_num].ways[replace_way].tag;
 				_tlb[replaced_tag].way = _num_ways;
-				uint32_t dirty_lines = __builtin_popcountll(_tlb[replaced_tag].dirty_bitvec) * 4;
-				uint32_t touch_lines = __builtin_popcountll(_tlb[replaced_tag].touch_bitvec) * 4;
+				uint32_t dirty_lines = getDirtyLines(replaced_tag, getFrame(set_num, replace_way));
+				uint32_t touch_lines = getTouchedLines(replaced_tag, getFrame(set_num, replace_way));
 				// used for evitc cacheline
 				if (_cache[set_num].ways[replace_way].dirty)
 				{
 					_numDirtyEviction.inc();
-					assert(dirty_lines > 0 && touch_lines <= 64);
-					MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-					_mcdram[mcdram_select]->access(load_req, 2, dirty_lines * 4);
-
-					MemReq wb_req = {_cache[set_num].ways[replace_way].tag * 64, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-					_ext_dram->cxl_access(wb_req, 2, dirty_lines * 4);
+					assert(dirty_lines > 0 && touch_lines <= _page_lines);
+					writebackDirtySectors(req, replaced_tag, getFrame(set_num, replace_way), mc_address, mcdram_select, true, cur_cycle);
 				}
 				else
 				{
@@ -2373,14 +2585,8 @@ MemoryController::ideal_cache_access(MemReq& req)
 			_cache[set_num].ways[replace_way].dirty = (req.type == PUTX);
 			_tlb[tag].way = replace_way;
 
-			uint64_t bit = (address - tag * 64) / 4;
-			assert(bit < 16 && bit >= 0);
-			bit = ((uint64_t)1UL) << bit;
-			_tlb[tag].touch_bitvec = 0;
-			_tlb[tag].dirty_bitvec = 0;
-			_tlb[tag].touch_bitvec |= bit;
-			if (type == STORE)
-				_tlb[tag].dirty_bitvec |= bit;
+			resetSectors(tag, getFrame(set_num, replace_way));
+			markSector(tag, getFrame(set_num, replace_way), address - tag * _page_lines, type == STORE);
 		}
 		else
 		{
@@ -2393,7 +2599,9 @@ MemoryController::ideal_cache_access(MemReq& req)
 		// LLC dirty eviction hit
 		MemReq write_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
 		req.cycle = _mcdram[mcdram_select]->access(write_req, 0, 4);
+		_mc_bw_per_step += 4;
 		data_ready_cycle = req.cycle;
+		_src_class |= SRC_HIT;
 		if (req.type == PUTX)
 		{
 			_numStoreHit.inc();
@@ -2401,18 +2609,17 @@ MemoryController::ideal_cache_access(MemReq& req)
 		}
 		else
 			_numLoadHit.inc();
+		if (_page_placement_policy->get_placement_policy() == PagePlacementPolicy::PRR)
+			_page_placement_policy->handleCacheHit(tag, type, set_num, &_cache[set_num], counter_access, hit_way);
 
 		// Update LRU information
-		MemReq tag_update_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+		MemReq tag_update_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_METADATA)};
 		_mcdram[mcdram_select]->access(tag_update_req, 2, 4); // min 64B
+		_mc_bw_per_step += 4;
 		invalid_data_size.inc(64); // update metadata
+		_src_class |= SRC_METADATA;
 		_numTagStore.inc();
-		uint64_t bit = (address - tag * 64) / 4;
-		assert(bit < 16 && bit >= 0);
-		bit = ((uint64_t)1UL) << bit;
-		_tlb[tag].touch_bitvec |= bit;
-		if (type == STORE)
-			_tlb[tag].dirty_bitvec |= bit;
+		markSector(tag, getFrame(set_num, hit_way), address - tag * _page_lines, type == STORE);
 	}
 	// if (counter_access)
 	// {
@@ -2427,15 +2634,629 @@ MemoryController::ideal_cache_access(MemReq& req)
 	// 	_mcdram[mcdram_select]->access(counter_req, 2, 2);
 	// 	_mc_bw_per_step += 4;
 	// }
+	updateWritebackBuffer(req);
+	updateSourceStats(req);
 	futex_unlock(&_lock);
 	return data_ready_cycle;
 }
 
 
 
-DDRMemory* 
+/**
+ * @brief Fast-forward warm-up. Applies the tag, page table and placement-policy updates of a 
+ * 		  demand access, with no timing model, events or stats. Dirty victims are dropped, as 
+ * 		  external memory has no functional contents. Only the page-granularity schemes that 
+ * 		  use PagePlacementPolicy are warmed up.
+ */
+void
+MemoryController::functionalAccess(Address lineAddr, bool isStore)
+{
+	if (_scheme != UnisonCache && _scheme != HybridCache && _scheme != BasicCache)
+		return;
+	// No requester is known in fast-forward; partitions by core fall back to core 0
+	MemReq req = {lineAddr, isStore? GETX : GETS, 0, nullptr, 0, nullptr, I, 0, 0};
+	futex_lock(&_lock);
+	ReqType type = isStore? STORE : LOAD;
+	Address tag = lineAddr / (_granularity / 64);
+	uint64_t set_num = tag % _num_sets;
+	bool counter_access = false;
+	if (_tlb.find(tag) == _tlb.end())
+		_tlb[tag] = TLBEntry{tag, _num_ways, 0, 0, 0};
+	TLBEntry& entry = _tlb[tag];
+
+	uint32_t way_num = entry.way;
+	if (way_num == _num_ways) {
+		if (set_num >= _ds_index)
+			way_num = placePage(req, tag, type, set_num, counter_access);
+		if (way_num == _num_ways) {
+			futex_unlock(&_lock);
+			return;
+		}
+		Way& way = _cache[set_num].ways[way_num];
+		if (way.valid)
+			_tlb[way.tag].way = _num_ways;
+		way.valid = true;
+		way.tag = tag;
+		way.dirty = false;
+		way.cleanVector();
+		entry.way = way_num;
+		resetSectors(tag, getFrame(set_num, way_num));
+	} else if (_scheme != BasicCache || _page_placement_policy->get_placement_policy() == PagePlacementPolicy::PRR) {
+		_page_placement_policy->handleCacheHit(tag, type, set_num, &_cache[set_num], counter_access, way_num);
+	}
+
+	Way& way = _cache[set_num].ways[way_num];
+	if (isStore)
+		way.dirty = true;
+	uint32_t line_idx = lineAddr - tag * _page_lines;
+	if (!way.valid_vector[line_idx]) {
+		uint32_t sector_lines = _huge_page && _scheme != BasicCache? _leaf_lines : _sector_size / 64;
+		uint32_t first = line_idx / sector_lines * sector_lines;
+		for (uint32_t i = first; i < first + sector_lines; i++)
+			way.valid_vector[i] = true;
+	}
+	way.touch_vector[line_idx] = true;
+	markSector(tag, getFrame(set_num, way_num), line_idx, isStore);
+	futex_unlock(&_lock);
+}
+
+void
+MemoryController::fillSector(Way& way, uint32_t line_idx, uint32_t sector_lines, bool fetched)
+{
+	uint32_t first = line_idx / sector_lines * sector_lines;
+	for (uint32_t i = first; i < first + sector_lines; i++)
+		way.valid_vector[i] = true;
+	if (fetched)
+		_numSectorFetchBytes.inc(sector_lines * 64);
+}
+
+void
+MemoryController::touchLine(Way& way, uint32_t line_idx)
+{
+	assert(way.valid_vector[line_idx]);
+	if (!way.touch_vector[line_idx]) {
+		way.touch_vector[line_idx] = true;
+		_numSectorUsefulBytes.inc(64);
+	}
+}
+
+uint32_t
+MemoryController::getUntouchedLines(const Way& way)
+{
+	uint32_t lines = 0;
+	for (uint32_t i = 0; i < way.valid_vector.size(); i++)
+		if (way.valid_vector[i] && !way.touch_vector[i])
+			lines++;
+	return lines;
+}
+
+void
+MemoryController::resetSectors(Address tag, uint64_t frame)
+{
+	_tlb[tag].touch_bitvec = 0;
+	_tlb[tag].dirty_bitvec = 0;
+	if (_huge_page)
+		memset(&_huge_sectors[frame], 0, sizeof(HugePageSectors));
+}
+
+void
+MemoryController::markSector(Address tag, uint64_t frame, uint32_t line_idx, bool dirty)
+{
+	assert(line_idx < _page_lines);
+	TLBEntry& entry = _tlb[tag];
+	uint32_t chunk = line_idx / _chunk_lines;
+	entry.touch_bitvec |= 1UL << chunk;
+	if (dirty)
+		entry.dirty_bitvec |= 1UL << chunk;
+	if (_huge_page) {
+		uint64_t bit = 1UL << (line_idx % _chunk_lines / _leaf_lines);
+		_huge_sectors[frame].touch[chunk] |= bit;
+		if (dirty)
+			_huge_sectors[frame].dirty[chunk] |= bit;
+	}
+}
+
+bool
+MemoryController::isSectorTouched(Address tag, uint64_t frame, uint32_t line_idx)
+{
+	uint32_t chunk = line_idx / _chunk_lines;
+	if (!(_tlb[tag].touch_bitvec & (1UL << chunk)))
+		return false;
+	if (!_huge_page)
+		return true;
+	return _huge_sectors[frame].touch[chunk] & (1UL << (line_idx % _chunk_lines / _leaf_lines));
+}
+
+uint32_t
+MemoryController::countSectorLines(Address tag, uint64_t frame, bool dirty)
+{
+	uint64_t chunks = dirty? _tlb[tag].dirty_bitvec : _tlb[tag].touch_bitvec;
+	if (!_huge_page)
+		return __builtin_popcountll(chunks) * _chunk_lines;
+	const uint64_t * sectors = dirty? _huge_sectors[frame].dirty : _huge_sectors[frame].touch;
+	uint32_t lines = 0;
+	for (; chunks; chunks &= chunks - 1)
+		lines += __builtin_popcountll(sectors[__builtin_ctzll(chunks)]) * _leaf_lines;
+	return lines;
+}
+
+/**
+ * @brief Tag hit on a huge page whose demanded sector was never touched: the sector is read 
+ * 		  from external memory on the critical path and then written into mcdram.
+ * @return cycle the demanded line is available
+ */
+uint64_t
+MemoryController::fetchSector(MemReq& req, Address tag, uint32_t line_idx, Address mc_address, uint32_t mcdram_select, bool cxl)
+{
+	MESIState state;
+	Address sector_addr = tag * _page_lines + line_idx / _leaf_lines * _leaf_lines;
+	MemReq load_req = {sector_addr, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+	uint64_t cycle = extAccess(load_req, 1, _leaf_lines * 4, cxl);
+	_ext_bw_per_step += _leaf_lines * 4;
+	MemReq insert_req = {mc_address, PUTX, req.childId, &state, cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+	_mcdram[mcdram_select]->access(insert_req, 2, _leaf_lines * 4);
+	_mc_bw_per_step += _leaf_lines * 4;
+	_numSectorFill.inc();
+	_numSectorFetchBytes.inc(_leaf_lines * 64);
+	migrate_data_size.inc(_leaf_lines * 64);
+	return cycle;
+}
+
+/**
+ * @brief Writes back the dirty sectors of an evicted page. Small pages go out as one entry with 
+ * 		  the TLBEntry dirty mask; huge pages as one entry per dirty chunk, with its sector mask.
+ */
+void
+MemoryController::writebackDirtySectors(MemReq& req, Address tag, uint64_t frame, Address mc_address, 
+										uint32_t mcdram_select, bool cxl, uint64_t cycle)
+{
+	uint64_t chunks = _tlb[tag].dirty_bitvec;
+	if (!_huge_page) {
+		evictDirtyPage(req, tag * _page_lines, mc_address, mcdram_select, chunks, _chunk_lines * 4, cxl, cycle);
+		return;
+	}
+	for (; chunks; chunks &= chunks - 1) {
+		uint32_t chunk = __builtin_ctzll(chunks);
+		uint64_t sectors = _huge_sectors[frame].dirty[chunk];
+		assert(sectors);
+		evictDirtyPage(req, tag * _page_lines + chunk * _chunk_lines, mc_address + chunk * _chunk_lines, mcdram_select, 
+					   sectors, _leaf_lines * 4, cxl, cycle);
+	}
+}
+
+/**
+ * @brief Dirty page eviction. The page is read from mcdram at eviction time, before its frame is
+ * 		  refilled, and then written to external memory, the write chained after the read and both
+ * 		  off the critical path. With a writeback buffer only the external write is deferred, and
+ * 		  dirty sectors of a page that is already queued are combined.
+ */
+void
+MemoryController::evictDirtyPage(MemReq& req, Address line_addr, Address mc_address, uint32_t mcdram_select, 
+								 uint64_t sector_mask, uint32_t sector_bursts, bool cxl, uint64_t cycle)
+{
+	WritebackEntry entry = {line_addr, sector_mask, sector_bursts, cxl, cycle};
+	MESIState state;
+	uint32_t bursts = entry.getBursts();
+	assert(bursts > 0);
+	// load page from mcdram
+	MemReq load_req = {mc_address, GETS, req.childId, &state, cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+	_mcdram[mcdram_select]->access(load_req, 2, bursts);
+	_mc_bw_per_step += bursts;
+
+	if (_wb_size == 0) {
+		// store page to ext dram, after the load above
+		issueWriteback(req, entry, cycle, 3);
+		return;
+	}
+	for (auto& queued : _wb_buffer) {
+		if (queued.line_addr == line_addr) {
+			assert(queued.sector_bursts == sector_bursts);
+			queued.sector_mask |= sector_mask;
+			_numWbCombine.inc();
+			return;
+		}
+	}
+	if (_wb_buffer.size() == _wb_size)
+		drainWriteback(req, 1, _numWbDrainFull);
+	_wb_buffer.push_back(entry);
+	_numWbInsert.inc();
+}
+
+/**
+ * @brief Writes a page to external memory. type 3 chains the write after the eviction's mcdram 
+ * 		  read; drained entries start their own background chain (type 2).
+ */
+void
+MemoryController::issueWriteback(MemReq& req, const WritebackEntry& entry, uint64_t cycle, int type)
+{
+	MESIState state;
+	uint32_t bursts = entry.getBursts();
+	MemReq wb_req = {entry.line_addr, PUTX, req.childId, &state, cycle, req.childLock, req.initialState, req.srcId, req.dramClassFlags(MemReq::DRAM_MIGRATION)};
+	extAccess(wb_req, type, bursts, entry.cxl);
+	_ext_bw_per_step += bursts;
+	_numWbBytes.inc(bursts * 16);
+}
+
+void
+MemoryController::drainWriteback(MemReq& req, uint32_t num_entries, Counter& reason)
+{
+	uint32_t n = std::min(num_entries, (uint32_t)_wb_buffer.size());
+	for (uint32_t i = 0; i < n; i++) {
+		const WritebackEntry& entry = _wb_buffer[i];
+		issueWriteback(req, entry, req.cycle, 2);
+		if (req.cycle > entry.enqueue_cycle)
+			_numWbCycles.inc(req.cycle - entry.enqueue_cycle);
+	}
+	_wb_buffer.erase(_wb_buffer.begin(), _wb_buffer.begin() + n);
+	reason.inc(n);
+}
+
+/**
+ * @brief Called once per request, after its own accesses are recorded. Drains the buffer down to 
+ * 		  the low watermark once it crosses the high watermark, or one entry at a time while 
+ * 		  external memory sees no other traffic.
+ */
+void
+MemoryController::updateWritebackBuffer(MemReq& req)
+{
+	if (_wb_buffer.empty())
+		return;
+	if (_wb_buffer.size() > _wb_high_watermark)
+		drainWriteback(req, _wb_buffer.size() - _wb_low_watermark, _numWbDrainHigh);
+	else if (req.cycle >= _ext_last_demand_cycle + _wb_idle_cycles)
+		drainWriteback(req, 1, _numWbDrainIdle);
+}
+
+/**
+ * @brief All external memory traffic goes through here, so that idle drains only see idle time.
+ * 		  A read of lines with a queued writeback first drains that entry, so it sees the dirty data.
+ * 		  Reads that start the timing record (type 0) drain right after, as nothing can be chained 
+ * 		  before them.
+ */
+uint64_t
+MemoryController::extAccess(MemReq& req, int type, uint32_t data_size, bool cxl)
+{
+	_ext_last_demand_cycle = std::max(_ext_last_demand_cycle, req.cycle);
+	int32_t conflict = -1;
+	if (!_wb_buffer.empty() && req.type != PUTX && req.type != PUTS) {
+		uint32_t lines = std::max(data_size / 4, 1u);
+		for (uint32_t i = 0; i < _wb_buffer.size(); i++) {
+			if (_wb_buffer[i].overlaps(req.lineAddr, lines)) {
+				conflict = i;
+				break;  // pages are combined, so at most one entry matches
+			}
+		}
+	}
+	if (conflict >= 0 && type != 0)
+		drainConflict(req, conflict);
+	uint64_t resp_cycle = cxl? _ext_dram->cxl_access(req, type, data_size) : _ext_dram->access(req, type, data_size);
+	if (conflict >= 0 && type == 0)
+		drainConflict(req, conflict);
+	return resp_cycle;
+}
+
+void
+MemoryController::drainConflict(MemReq& req, uint32_t idx)
+{
+	WritebackEntry entry = _wb_buffer[idx];
+	_wb_buffer.erase(_wb_buffer.begin() + idx);
+	issueWriteback(req, entry, req.cycle, 2);
+	if (req.cycle > entry.enqueue_cycle)
+		_numWbCycles.inc(req.cycle - entry.enqueue_cycle);
+	_numWbDrainConflict.inc();
+}
+
+static void writeBitVector(FILE* f, const g_vector<bool>& v)
+{
+	uint32_t size = v.size();
+	writeWarmState(f, &size);
+	for (uint32_t i = 0; i < size; i += 64) {
+		uint64_t word = 0;
+		for (uint32_t j = i; j < std::min(size, i + 64); j++)
+			if (v[j]) word |= 1UL << (j - i);
+		writeWarmState(f, &word);
+	}
+}
+
+static void readBitVector(FILE* f, g_vector<bool>& v)
+{
+	uint32_t size;
+	readWarmState(f, &size);
+	if (size != v.size()) panic("Warm state line vector has %d entries, expected %ld", size, v.size());
+	for (uint32_t i = 0; i < size; i += 64) {
+		uint64_t word;
+		readWarmState(f, &word);
+		for (uint32_t j = i; j < std::min(size, i + 64); j++)
+			v[j] = (word >> (j - i)) & 1;
+	}
+}
+
+/**
+ * @brief Per-controller section of the warm-state file. The header (name and cache geometry) 
+ * 		  is checked on load, so a checkpoint can only be restored into the same configuration.
+ * 		  Page table entries of uncached pages with no count are not stored, they are recreated 
+ * 		  on first access exactly as they would be in a cold run.
+ */
+void 
+MemoryController::saveWarmState(FILE* f)
+{
+	futex_lock(&_lock);
+	uint32_t name_len = _name.size();
+	uint32_t scheme = _scheme;
+	writeWarmState(f, &name_len);
+	writeWarmState(f, _name.c_str(), name_len);
+	writeWarmState(f, &scheme);
+	if (_scheme == NoCache) {
+		futex_unlock(&_lock);
+		return;
+	}
+	writeWarmState(f, &_num_sets);
+	writeWarmState(f, &_num_ways);
+	writeWarmState(f, &_granularity);
+
+	for (uint64_t i = 0; i < _num_sets; i++) {
+		for (uint32_t j = 0; j < _num_ways; j++) {
+			Way& way = _cache[i].ways[j];
+			writeWarmState(f, &way.tag);
+			writeWarmState(f, &way.valid);
+			writeWarmState(f, &way.dirty);
+			writeWarmState(f, &way.lru_value);
+			writeBitVector(f, way.valid_vector);
+			writeBitVector(f, way.dirty_vector);
+			writeBitVector(f, way.touch_vector);
+		}
+	}
+	writeWarmState(f, &_next_evict_idx);
+	writeWarmState(f, &_ds_index);
+
+	uint64_t num_entries = 0;
+	for (auto& it : _tlb)
+		if (it.second.way != _num_ways || it.second.count)
+			num_entries++;
+	writeWarmState(f, &num_entries);
+	for (auto& it : _tlb) {
+		if (it.second.way != _num_ways || it.second.count) {
+			writeWarmState(f, &it.first);
+			writeWarmState(f, &it.second);
+		}
+	}
+	if (_huge_page)
+		writeWarmState(f, _huge_sectors, _num_sets * _num_ways);
+
+	uint32_t wb_entries = _wb_buffer.size();
+	writeWarmState(f, &wb_entries);
+	writeWarmState(f, _wb_buffer.data(), wb_entries);
+
+	// Way allocations of the last repartition and the owner of every cached page
+	uint32_t num_partitions = _part_mapper ? _num_partitions : 0;
+	writeWarmState(f, &num_partitions);
+	if (_part_mapper) {
+		writeWarmState(f, _part_ways, _num_partitions);
+		writeWarmState(f, _way_part, _num_ways);
+		writeWarmState(f, _page_part, _num_sets * _num_ways);
+		writeWarmState(f, _part_pages, _num_partitions);
+	}
+
+	if (_scheme == UnisonCache || _scheme == HybridCache || _scheme == BasicCache)
+		_page_placement_policy->saveState(f);
+	if (_scheme == HybridCache)
+		_tag_buffer->saveState(f);
+	if (_scheme == Trimma) {
+		_iRT.saveState(f);
+		_idCache.saveState(f);
+		_nonIdCache.saveState(f);
+	}
+	futex_unlock(&_lock);
+}
+
+void 
+MemoryController::loadWarmState(FILE* f)
+{
+	futex_lock(&_lock);
+	uint32_t name_len, scheme;
+	readWarmState(f, &name_len);
+	g_string name(name_len, ' ');
+	readWarmState(f, &name[0], name_len);
+	readWarmState(f, &scheme);
+	if (name != _name || scheme != (uint32_t)_scheme)
+		panic("Warm state section %s (scheme %d) does not match controller %s (scheme %d)", 
+			name.c_str(), scheme, _name.c_str(), _scheme);
+	if (_scheme == NoCache) {
+		futex_unlock(&_lock);
+		return;
+	}
+	uint64_t num_sets, num_ways, granularity;
+	readWarmState(f, &num_sets);
+	readWarmState(f, &num_ways);
+	readWarmState(f, &granularity);
+	if (num_sets != _num_sets || num_ways != _num_ways || granularity != _granularity)
+		panic("%s: warm state geometry %ld sets x %ld ways x %ldB, expected %ld x %ld x %ldB", _name.c_str(),
+			num_sets, num_ways, granularity, _num_sets, _num_ways, _granularity);
+
+	for (uint64_t i = 0; i < _num_sets; i++) {
+		for (uint32_t j = 0; j < _num_ways; j++) {
+			Way& way = _cache[i].ways[j];
+			readWarmState(f, &way.tag);
+			readWarmState(f, &way.valid);
+			readWarmState(f, &way.dirty);
+			readWarmState(f, &way.lru_value);
+			readBitVector(f, way.valid_vector);
+			readBitVector(f, way.dirty_vector);
+			readBitVector(f, way.touch_vector);
+		}
+	}
+	readWarmState(f, &_next_evict_idx);
+	readWarmState(f, &_ds_index);
+
+	uint64_t num_entries;
+	readWarmState(f, &num_entries);
+	_tlb.clear();
+	for (uint64_t i = 0; i < num_entries; i++) {
+		Address tag;
+		TLBEntry entry;
+		readWarmState(f, &tag);
+		readWarmState(f, &entry);
+		_tlb[tag] = entry;
+	}
+	if (_huge_page)
+		readWarmState(f, _huge_sectors, _num_sets * _num_ways);
+
+	uint32_t wb_entries;
+	readWarmState(f, &wb_entries);
+	if (wb_entries > _wb_size)
+		panic("%s: warm state has %d queued writebacks, buffer holds %d", _name.c_str(), wb_entries, _wb_size);
+	_wb_buffer.resize(wb_entries);
+	readWarmState(f, _wb_buffer.data(), wb_entries);
+
+	uint32_t num_partitions;
+	readWarmState(f, &num_partitions);
+	if (num_partitions != (_part_mapper ? _num_partitions : 0))
+		panic("%s: warm state has %d cache partitions, expected %d", _name.c_str(), num_partitions, _part_mapper ? _num_partitions : 0);
+	if (_part_mapper) {
+		readWarmState(f, _part_ways, _num_partitions);
+		readWarmState(f, _way_part, _num_ways);
+		readWarmState(f, _page_part, _num_sets * _num_ways);
+		readWarmState(f, _part_pages, _num_partitions);
+	}
+
+	if (_scheme == UnisonCache || _scheme == HybridCache || _scheme == BasicCache)
+		_page_placement_policy->loadState(f);
+	if (_scheme == HybridCache)
+		_tag_buffer->loadState(f);
+	if (_scheme == Trimma) {
+		_iRT.loadState(f);
+		_idCache.loadState(f);
+		_nonIdCache.loadState(f);
+	}
+	futex_unlock(&_lock);
+}
+
+#define WARM_STATE_MAGIC 0x4d5241574d43445aUL // "ZDCMWARM"
+
+void SaveDramCacheWarmState(const char* file)
+{
+	FILE* f = fopen(file, "wb");
+	if (!f) panic("Could not open %s to save the DRAM cache warm state", file);
+	uint64_t magic = WARM_STATE_MAGIC;
+	uint32_t num_mcs = zinfo->dramCaches->size();
+	writeWarmState(f, &magic);
+	writeWarmState(f, &num_mcs);
+	for (MemoryController* mc : *zinfo->dramCaches)
+		mc->saveWarmState(f);
+	fclose(f);
+	info("Saved DRAM cache warm state of %d controllers to %s", num_mcs, file);
+}
+
+void LoadDramCacheWarmState(const char* file)
+{
+	FILE* f = fopen(file, "rb");
+	if (!f) panic("Could not open DRAM cache warm state %s", file);
+	uint64_t magic;
+	uint32_t num_mcs;
+	readWarmState(f, &magic);
+	readWarmState(f, &num_mcs);
+	if (magic != WARM_STATE_MAGIC) panic("%s is not a DRAM cache warm state file", file);
+	if (num_mcs != zinfo->dramCaches->size())
+		panic("%s holds %d DRAM cache controllers, the system has %ld", file, num_mcs, zinfo->dramCaches->size());
+	for (MemoryController* mc : *zinfo->dramCaches)
+		mc->loadWarmState(f);
+	fclose(f);
+	info("Restored DRAM cache warm state of %d controllers from %s", num_mcs, file);
+}
+
+void
+SourceBreakdown::init(AggregateStat* parentStat, const char* name, const char* desc, uint32_t size)
+{
+	AggregateStat* stats = new AggregateStat();
+	stats->init(name, desc);
+	requests.init("requests", "Requests", size); stats->append(&requests);
+	hits.init("hits", "Load and store hits", size); stats->append(&hits);
+	misses.init("misses", "Load and store misses", size); stats->append(&misses);
+	migrateBytes.init("migrateBytes", "Bytes migrated or fetched into the cache", size); stats->append(&migrateBytes);
+	metadataBytes.init("metadataBytes", "Bytes of tag and replacement metadata traffic", size); stats->append(&metadataBytes);
+	latency.init("latency", "Sum of request latencies (cycles)", size); stats->append(&latency);
+	parentStat->append(stats);
+}
+
+void
+MemoryController::updateSourceStats(const MemReq& req)
+{
+	uint64_t migrate = migrate_data_size.get() + _numSectorFetchBytes.get();
+	uint64_t metadata = invalid_data_size.get() + policy_update_size.get();
+	uint32_t core = req.srcId;
+	uint32_t proc = req.lineAddr >> (64 - lineBits);
+	SourceBreakdown* breakdowns[] = {&_coreStats, &_procStats};
+	uint32_t idx[] = {core, proc};
+	for (uint32_t i = 0; i < 2; i++) {
+		if (idx[i] >= breakdowns[i]->requests.size())
+			continue;
+		if (_src_class & SRC_HIT) breakdowns[i]->hits.inc(idx[i]);
+		if (_src_class & SRC_MISS) breakdowns[i]->misses.inc(idx[i]);
+		breakdowns[i]->migrateBytes.inc(idx[i], migrate - _src_last_migrate);
+		breakdowns[i]->metadataBytes.inc(idx[i], metadata - _src_last_metadata);
+	}
+	if (core < zinfo->numCores)
+		_src_lat_class[core] = _src_class;
+	_src_class = 0;
+	_src_last_migrate = migrate;
+	_src_last_metadata = metadata;
+}
+
+// Called after _lock is released, hence atomic
+void
+MemoryController::recordSourceLatency(const MemReq& req, uint64_t start_cycle, uint64_t resp_cycle)
+{
+	uint32_t core = req.srcId;
+	uint32_t proc = req.lineAddr >> (64 - lineBits);
+	if (core < _coreStats.requests.size()) {
+		_coreStats.requests.atomicInc(core);
+		_coreStats.latency.atomicInc(core, resp_cycle - start_cycle);
+	}
+	if (proc < _procStats.requests.size()) {
+		_procStats.requests.atomicInc(proc);
+		_procStats.latency.atomicInc(proc, resp_cycle - start_cycle);
+	}
+	// A core has one request in flight, so its class slot is not raced on
+	uint8_t cls = 0;
+	EventRecorder* evRec = nullptr;
+	if (core < zinfo->numCores) {
+		cls = _src_lat_class[core];
+		_src_lat_class[core] = 0;
+		evRec = zinfo->eventRecorders[core];
+	}
+	if (!evRec || !evRec->hasRecord()) {
+		// No weave-phase timing for this request, so the bound-phase latency is all there is
+		recordLatency(cls, resp_cycle - start_cycle);
+		return;
+	}
+	// Bracket the request's timing record with probes, so the histograms see the
+	// weave-phase latency, with DDR queuing and migration bursts
+	TimingRecord tr = evRec->popRecord();
+	assert(tr.startEvent && tr.endEvent);
+	LatencyEndEvent* endEv = new (evRec) LatencyEndEvent(this, cls);
+	LatencyStartEvent* startEv = new (evRec) LatencyStartEvent(endEv);
+	startEv->setMinStartCycle(tr.reqCycle);
+	endEv->setMinStartCycle(tr.reqCycle);
+	startEv->addChild(tr.startEvent, evRec);
+	tr.endEvent->addChild(endEv, evRec);
+	tr.startEvent = startEv;
+	evRec->pushRecord(tr);
+}
+
+// Called from the weave phase (or from recordSourceLatency() without event recording), hence atomic
+void
+MemoryController::recordLatency(uint8_t cls, uint64_t lat)
+{
+	_latAll.atomicInc(lat);
+	if (cls & SRC_HIT) _latHit.atomicInc(lat);
+	if (cls & SRC_MISS) _latMiss.atomicInc(lat);
+	if (cls & SRC_METADATA) _latMetadata.atomicInc(lat);
+}
+
+MemObject* 
 MemoryController::BuildDDRMemory(Config& config, uint32_t frequency, 
-								 uint32_t domain, g_string name, const string& prefix, uint32_t tBL, double timing_scale) 
+								 uint32_t domain, g_string name, const string& prefix, uint32_t tBL, double timing_scale,
+								 g_vector<DDRMemory*>& chans) 
 {
     uint32_t ranksPerChannel = config.get<uint32_t>(prefix + "ranksPerChannel", 4);
     uint32_t banksPerRank = config.get<uint32_t>(prefix + "banksPerRank", 8);  // DDR3 std is 8
@@ -2455,8 +3276,40 @@ MemoryController::BuildDDRMemory(Config& config, uint32_t frequency,
     uint32_t queueDepth = config.get<uint32_t>(prefix + "queueDepth", 16);
     uint32_t controllerLatency = config.get<uint32_t>(prefix + "controllerLatency", 10);  // in system cycles
 
-    auto mem = (DDRMemory *) gm_malloc(sizeof(DDRMemory));
-	new (mem) DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech, addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name, tBL, timing_scale);
+    // Row buffer bytes and bank groups per rank, 0 for the technology defaults
+    uint32_t rowSize = config.get<uint32_t>(prefix + "rowSize", 0);
+    uint32_t bankGroups = config.get<uint32_t>(prefix + "bankGroups", 0);
+    uint32_t pseudoChannels = config.get<uint32_t>(prefix + "pseudoChannels", DDRMemory::getTechPseudoChannels(tech));
+    assert(pseudoChannels > 0);
+
+    // Bulk transfers (page fills, migrations) vs. demand requests: fcfs, demand (first) or bulk (first)
+    uint32_t bulkPriority = DDRMemory::parseBulkPriority(config.get<const char*>(prefix + "bulkPriority", "fcfs"));
+    // XOR-fold the row into the bank and rank bits (permutation-based interleaving)
+    bool xorHash = config.get<bool>(prefix + "xorHash", false);
+    // all (REFab), perBank (REFpb, e.g. HBM) or sameBank (REFsb, DDR5)
+    uint32_t refreshMode = DDRMemory::parseRefreshMode(config.get<const char*>(prefix + "refreshMode", "all"));
+
+    // Write drains (with deferWrites), in queued writes: drain from the high watermark down to the low one,
+    // or while there are no reads if at least idleDrainMin writes are queued
+    uint32_t writeHighMark = config.get<uint32_t>(prefix + "writeHighWatermark", 3*queueDepth/4);
+    uint32_t writeLowMark = config.get<uint32_t>(prefix + "writeLowWatermark", queueDepth/4);
+    uint32_t idleDrainMin = config.get<uint32_t>(prefix + "idleDrainMin", 1);
+    // Idle memory cycles a WR burst leaves after a RD burst, before timing scaling; off by default
+    uint32_t tRTW = config.get<uint32_t>(prefix + "tRTW", 0);
+
+    g_vector<DDRMemory*> pcs;
+    for (uint32_t i = 0; i < pseudoChannels; i++) {
+        g_string pc_name = (pseudoChannels == 1)? name : name + g_string("-pc") + g_string(to_string(i).c_str());
+        auto mem = (DDRMemory *) gm_malloc(sizeof(DDRMemory));
+		new (mem) DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech, addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, pc_name, tBL, timing_scale, rowSize, bankGroups, bulkPriority, xorHash, refreshMode,
+				writeHighMark, writeLowMark, idleDrainMin, tRTW);
+        pcs.push_back(mem);
+        chans.push_back(mem);
+    }
+    if (pseudoChannels == 1)
+        return pcs[0];
+    auto mem = (DDRPseudoChannels *) gm_malloc(sizeof(DDRPseudoChannels));
+    new (mem) DDRPseudoChannels(pcs, name);
     return mem;
 }
 
@@ -2493,6 +3346,64 @@ MemoryController::initStats(AggregateStat* parentStat)
 	migrate_data_size.init("TotalMigrate","total # bytes of migation data");memStats->append(&migrate_data_size);
 	policy_update_size.init("TotalPolicy","total # bytes of replacement tags");memStats->append(&policy_update_size);
 
+	_numSectorFill.init("sectorFill", "Tag hits that missed on the sector and filled it"); memStats->append(&_numSectorFill);
+	_numSectorFetchBytes.init("sectorFetchBytes", "Bytes fetched from external memory into the cache"); memStats->append(&_numSectorFetchBytes);
+	_numSectorUsefulBytes.init("sectorUsefulBytes", "Fetched bytes later touched by a request"); memStats->append(&_numSectorUsefulBytes);
+	_numSectorWastedBytes.init("sectorWastedBytes", "Fetched bytes evicted without being touched"); memStats->append(&_numSectorWastedBytes);
+	_numWbInsert.init("wbInsert", "Dirty pages inserted into the writeback buffer"); memStats->append(&_numWbInsert);
+	_numWbCombine.init("wbCombine", "Dirty pages combined with a queued writeback"); memStats->append(&_numWbCombine);
+	_numWbDrainFull.init("wbDrainFull", "Writebacks drained because the buffer was full"); memStats->append(&_numWbDrainFull);
+	_numWbDrainHigh.init("wbDrainHigh", "Writebacks drained above the high watermark"); memStats->append(&_numWbDrainHigh);
+	_numWbDrainIdle.init("wbDrainIdle", "Writebacks drained while external memory was idle"); memStats->append(&_numWbDrainIdle);
+	_numWbBytes.init("wbBytes", "Bytes written back to external memory"); memStats->append(&_numWbBytes);
+	_numWbDrainConflict.init("wbDrainConflict", "Writebacks drained before a read of the same lines"); memStats->append(&_numWbDrainConflict);
+	_numWbCycles.init("wbCycles", "Total cycles drained entries spent in the writeback buffer"); memStats->append(&_numWbCycles);
+	_coreStats.init(memStats, "core", "Per-core breakdown", zinfo->numCores);
+	_procStats.init(memStats, "proc", "Per-process breakdown", zinfo->numProcs);
+	_latAll.init(memStats, "latHist", "End-to-end latency distribution, from the weave phase (cycles)");
+	_latHit.init(memStats, "latHistHit", "Latency distribution of hits");
+	_latMiss.init(memStats, "latHistMiss", "Latency distribution of misses");
+	_latMetadata.init(memStats, "latHistMetadata", "Latency distribution of requests with metadata traffic");
+	if (_part_mapper) {
+		AggregateStat* partStats = new AggregateStat();
+		partStats->init("part", "Way partitioning stats");
+		auto pagesStat = makeLambdaVectorStat([this](uint32_t p) { return _part_pages[p]; }, _num_partitions);
+		pagesStat->init("pages", "Cached pages owned by each partition");
+		partStats->append(pagesStat);
+		auto waysStat = makeLambdaVectorStat([this](uint32_t p) { return (uint64_t)_part_ways[p]; }, _num_partitions);
+		waysStat->init("ways", "Ways allocated to each partition");
+		partStats->append(waysStat);
+		_numRepartitions.init("repartitions", "Number of way reallocations"); partStats->append(&_numRepartitions);
+		memStats->append(partStats);
+	}
+
+
+	if (_scheme != NoCache) {
+		_numMcdramAccess.init("mcdramAcc", "Requests per MC-Dram channel", _mcdram_per_mc); memStats->append(&_numMcdramAccess);
+		auto imbalance = makeLambdaStat([this]() { return vectorImbalance(_numMcdramAccess); });
+		imbalance->init("mcdramImbalance", "Max over mean requests per MC-Dram channel, x1000"); memStats->append(imbalance);
+	}
+
+	if (!_mcdram_chans.empty() || !_ext_dram_chans.empty()) {
+		AggregateStat* energyStats = new AggregateStat();
+		energyStats->init("energy", "DRAM energy per tier, in pJ");
+		uint32_t classes = DDRMemory::ENERGY_CLASSES + 1;
+		auto fastEnergy = makeLambdaVectorStat([this](uint32_t c) { return getTierEnergy(_mcdram_chans, c); }, classes);
+		fastEnergy->init("fast", "MC-Dram energy (demand, metadata, migration, static)");
+		energyStats->append(fastEnergy);
+		auto farEnergy = makeLambdaVectorStat([this](uint32_t c) { return getTierEnergy(_ext_dram_chans, c); }, classes);
+		farEnergy->init("far", "External memory energy (demand, metadata, migration, static)");
+		energyStats->append(farEnergy);
+		auto perReq = makeLambdaStat([this, classes]() {
+			uint64_t energy = 0, requests = 0;
+			for (uint32_t c = 0; c < classes; c++) energy += getTierEnergy(_mcdram_chans, c) + getTierEnergy(_ext_dram_chans, c);
+			for (uint32_t i = 0; i < _coreStats.requests.size(); i++) requests += _coreStats.requests.count(i);
+			return requests? energy / requests : 0;
+		});
+		perReq->init("perReq", "Energy of both tiers per request");
+		energyStats->append(perReq);
+		memStats->append(energyStats);
+	}
 
 	_ext_dram->initStats(memStats);
 	for (uint32_t i = 0; i < _mcdram_per_mc; i++) 
@@ -2501,6 +3412,165 @@ MemoryController::initStats(AggregateStat* parentStat)
     parentStat->append(memStats);
 }
 
+// Energy of a tier's DDR channels for one DDRMemory::EnergyClass, or static energy (refresh
+// and background) for energyClass == ENERGY_CLASSES
+uint64_t
+MemoryController::getTierEnergy(const g_vector<DDRMemory*>& chans, uint32_t energyClass) const
+{
+	uint64_t energy = 0;
+	for (DDRMemory* chan : chans)
+		energy += (energyClass < DDRMemory::ENERGY_CLASSES)? chan->getClassEnergy(energyClass) : chan->getStaticEnergy();
+	return energy;
+}
+
+// MC-Dram channels interleave at 4KB (64 lines); the line's offset within its
+// channel, (address / 64 / _mcdram_per_mc * 64) | (address % 64), holds either way
+uint32_t
+MemoryController::selectMcdram(Address address)
+{
+	uint32_t select = _mcdram_hash? hashInterleave(address / 64, _mcdram_per_mc) : (address / 64) % _mcdram_per_mc;
+	_numMcdramAccess.inc(select);
+	return select;
+}
+
+// Halves the per-step counters that steer bandwidth balancing, after folding the 
+// bandwidth they accumulated since the last fold into the running totals.
+void
+MemoryController::decayStepStats()
+{
+	foldStepBandwidth();
+	_num_hit_per_step /= 2;
+	_num_miss_per_step /= 2;
+	_mc_bw_per_step /= 2;
+	_ext_bw_per_step /= 2;
+	_mc_bw_folded = _mc_bw_per_step;
+	_ext_bw_folded = _ext_bw_per_step;
+}
+
+void
+MemoryController::foldStepBandwidth()
+{
+	_mc_bw_total += _mc_bw_per_step - _mc_bw_folded;
+	_ext_bw_total += _ext_bw_per_step - _ext_bw_folded;
+	_mc_bw_folded = _mc_bw_per_step;
+	_ext_bw_folded = _ext_bw_per_step;
+}
+
+// Called after the request's traffic is dispatched, so the sample closing an interval includes it
+void
+MemoryController::sampleInterval(uint64_t cycle)
+{
+	if (!_interval_cycles || cycle < _next_interval_cycle)
+		return;
+	futex_lock(&_lock);
+	if (cycle >= _next_interval_cycle)
+		recordInterval(cycle);
+	futex_unlock(&_lock);
+}
+
+/**
+ * @brief Closes the current interval (called with _lock held). Bound-phase cycles of different 
+ * 		  cores are not ordered, so the sample is charged to the first request past the boundary, 
+ * 		  and intervals with no requests are skipped.
+ */
+void
+MemoryController::recordInterval(uint64_t cycle)
+{
+	foldStepBandwidth();
+	IntervalSample now;
+	now.cycle = cycle;
+	now.hits = _numLoadHit.get() + _numStoreHit.get();
+	now.misses = _numLoadMiss.get() + _numStoreMiss.get();
+	now.mcBytes = _mc_bw_total * 16;
+	now.extBytes = _ext_bw_total * 16;
+	now.metadataBytes = invalid_data_size.get() + policy_update_size.get();
+	now.migrateBytes = migrate_data_size.get() + _numSectorFetchBytes.get();
+	now.wbQueue = _wb_buffer.size();
+
+	if (_interval_count == _interval_buf_size)
+		flushIntervals();
+	IntervalSample& sample = _interval_buf[(_interval_head + _interval_count) % _interval_buf_size];
+	sample = now;
+	sample.hits -= _interval_last.hits;
+	sample.misses -= _interval_last.misses;
+	sample.mcBytes -= _interval_last.mcBytes;
+	sample.extBytes -= _interval_last.extBytes;
+	sample.metadataBytes -= _interval_last.metadataBytes;
+	sample.migrateBytes -= _interval_last.migrateBytes;
+	_interval_count++;
+	_interval_last = now;
+	_next_interval_cycle = (cycle / _interval_cycles + 1) * _interval_cycles;
+}
+
+// Appends the buffered samples to the CSV file. Also called at the end of the simulation.
+void
+MemoryController::flushIntervals()
+{
+	if (!_interval_cycles || !_interval_count)
+		return;
+	FILE * f = fopen(_interval_file.c_str(), "a");
+	if (!f) panic("%s: cannot open %s", _name.c_str(), _interval_file.c_str());
+	for (; _interval_count > 0; _interval_count--) {
+		const IntervalSample& s = _interval_buf[_interval_head];
+		uint64_t total = s.hits + s.misses;
+		fprintf(f, "%ld,%ld,%ld,%.4f,%ld,%ld,%ld,%ld,%d\n", s.cycle, s.hits, s.misses, 
+				total? 1.0 * s.hits / total : 0.0, s.mcBytes, s.extBytes, s.metadataBytes, s.migrateBytes, s.wbQueue);
+		_interval_head = (_interval_head + 1) % _interval_buf_size;
+	}
+	fclose(f);
+}
+
+uint32_t
+MemoryController::placePage(const MemReq& req, Address tag, ReqType type, uint64_t set_num, bool& counter_access)
+{
+	if (!_part_mapper)
+		return _page_placement_policy->handleCacheMiss(tag, type, set_num, &_cache[set_num], counter_access);
+	uint32_t part = _part_mapper->getPartition(req);
+	assert(part < _num_partitions);
+	uint32_t way = _page_placement_policy->handleCacheMiss(tag, type, set_num, &_cache[set_num], counter_access, part);
+	if (way < _num_ways) {
+		uint32_t& owner = _page_part[set_num * _num_ways + way];
+		if (_cache[set_num].ways[way].valid)
+			_part_pages[owner]--;
+		owner = part;
+		_part_pages[part]++;
+	}
+	return way;
+}
+
+void
+MemoryController::setPartitionWays(const uint32_t* allocs)
+{
+	uint32_t way = 0;
+	for (uint32_t p = 0; p < _num_partitions; p++) {
+		_part_ways[p] = allocs[p];
+		for (uint32_t i = 0; i < allocs[p]; i++)
+			_way_part[way++] = p;
+	}
+	assert(way == _num_ways);
+}
+
+/**
+ * @brief Reallocates ways from the UMON utility curves of the last interval. Pages cached 
+ * 		  in ways that change owner stay put and are reclaimed by their new partition on 
+ * 		  its next miss in the set.
+ */
+void
+MemoryController::repartition()
+{
+	futex_lock(&_lock);
+	futex_lock(&_part_lock);
+	// computeBestPartitioning gives every partition minAlloc but only debits the
+	// balance once, so reserve the other partitions' minimums up front.
+	uint32_t buckets = _num_ways - (_num_partitions - 1) * _part_min_ways;
+	uint32_t allocs[_num_partitions];
+	lookahead::computeBestPartitioning(_num_partitions, buckets, _part_min_ways, nullptr, allocs, *_part_monitor);
+	setPartitionWays(allocs);
+	_part_monitor->reset();
+	_numRepartitions.inc();
+	futex_unlock(&_part_lock);
+	futex_unlock(&_lock);
+}
 
 Address 
 MemoryController::transMCAddress(Address mc_addr)
@@ -2657,4 +3727,27 @@ TagBuffer::clearTagBuffer()
 			_tag_buffer[i][j].lru = j;
 		}
 	}
-}
\ No newline at end of file
+}
+
+void
+TagBuffer::saveState(FILE* f)
+{
+	writeWarmState(f, &_num_sets);
+	writeWarmState(f, &_entry_occupied);
+	writeWarmState(f, &_last_clear_time);
+	for (uint32_t i = 0; i < _num_sets; i++)
+		writeWarmState(f, _tag_buffer[i], _num_ways);
+}
+
+void
+TagBuffer::loadState(FILE* f)
+{
+	uint32_t num_sets;
+	readWarmState(f, &num_sets);
+	if (num_sets != _num_sets) panic("Tag buffer warm state has %d sets, expected %d", num_sets, _num_sets);
+	readWarmState(f, &_entry_occupied);
+	readWarmState(f, &_last_clear_time);
+	for (uint32_t i = 0; i < _num_sets; i++)
+		readWarmState(f, _tag_buffer[i], _num_ways);
+}
+
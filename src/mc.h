@@ -6,6 +6,7 @@
 #include "memory_hierarchy.h"
 #include <string>
 #include "stats.h"
+#include "latency_hist.h"
 #include "g_std/g_unordered_map.h"
 #include "g_std/g_vector.h"
 #include<math.h>
@@ -14,7 +15,17 @@
 #include <array>
 #include <cstdint>
 
-#define MAX_STEPS 10000
+// DRAM cache warm-state checkpoint I/O (see MemoryController::saveWarmState).
+// Raw host-endian records; a checkpoint is only meant to be reloaded by the same build.
+template <typename T>
+static inline void writeWarmState(FILE* f, const T* data, uint64_t n = 1) {
+	if (n && fwrite(data, sizeof(T), n, f) != n) panic("Failed to write DRAM cache warm state");
+}
+
+template <typename T>
+static inline void readWarmState(FILE* f, T* data, uint64_t n = 1) {
+	if (n && fread(data, sizeof(T), n, f) != n) panic("Truncated DRAM cache warm state");
+}
 
 enum ReqType
 {
@@ -103,6 +114,20 @@ public:
 
 	NonIdCache() : sets(2048){}
 
+	void saveState(FILE* f) const {
+		for (const auto& set : sets) {
+			writeWarmState(f, set.ways.data(), set.ways.size());
+			writeWarmState(f, set.lru_value.data(), set.lru_value.size());
+		}
+	}
+
+	void loadState(FILE* f) {
+		for (auto& set : sets) {
+			readWarmState(f, set.ways.data(), set.ways.size());
+			readWarmState(f, set.lru_value.data(), set.lru_value.size());
+		}
+	}
+
 	NonIdLookupResult lookup(PhysicalAddr pa) 
 	{  // 参数列表仅含pa
         uint32_t set_idx = (pa >> 8) & 0x7FF;
@@ -193,6 +218,22 @@ public:
 
 	IdCache() : sets(256){}
 
+	void saveState(FILE* f) const {
+		writeWarmState(f, &timestamp);
+		for (const auto& set : sets) {
+			writeWarmState(f, set.ways.data(), set.ways.size());
+			writeWarmState(f, set.access_time.data(), set.access_time.size());
+		}
+	}
+
+	void loadState(FILE* f) {
+		readWarmState(f, &timestamp);
+		for (auto& set : sets) {
+			readWarmState(f, set.ways.data(), set.ways.size());
+			readWarmState(f, set.access_time.data(), set.access_time.size());
+		}
+	}
+
  	IdLookupResult lookup(PhysicalAddr pa) {
     // 计算超级块标签和块索引
     const uint32_t kSuperBlockSize = 8192; // 8KB
@@ -348,7 +389,7 @@ private:
     std::vector<uint32_t> tag_roots_; // 每个集合的根节点索引
 
 public:
-    iRT(int sets) : tag_roots_(sets, INVALID_INDEX) {
+    explicit iRT(int sets = 0) : tag_roots_(sets, INVALID_INDEX) {
         // 预分配所有根节点（中间节点）
         for (auto& root_idx : tag_roots_) {
             root_idx = allocate_node(false); 
@@ -413,6 +454,25 @@ public:
         }
     }
 
+    void saveState(FILE* f) const {
+        uint64_t num_roots = tag_roots_.size();
+        uint64_t num_nodes = node_pool_.size();
+        writeWarmState(f, &num_roots);
+        writeWarmState(f, &num_nodes);
+        writeWarmState(f, tag_roots_.data(), num_roots);
+        writeWarmState(f, node_pool_.data(), num_nodes);
+    }
+
+    void loadState(FILE* f) {
+        uint64_t num_roots, num_nodes;
+        readWarmState(f, &num_roots);
+        readWarmState(f, &num_nodes);
+        if (num_roots != tag_roots_.size()) panic("iRT warm state has %ld sets, expected %ld", num_roots, tag_roots_.size());
+        node_pool_.resize(num_nodes);
+        readWarmState(f, tag_roots_.data(), num_roots);
+        readWarmState(f, node_pool_.data(), num_nodes);
+    }
+
 private:
     uint32_t allocate_node(bool is_leaf) {
         node_pool_.emplace_back(is_leaf);
@@ -610,6 +670,7 @@ public:
 
    g_vector<bool> valid_vector;
    g_vector<bool> dirty_vector;
+   g_vector<bool> touch_vector; // line requested since it was fetched
 
    void cleanVector()
    {
@@ -617,6 +678,7 @@ public:
 	  {
 		valid_vector[i]=false;
 		dirty_vector[i]=false;
+		touch_vector[i]=false;
 	  }
    }
 };
@@ -691,6 +753,8 @@ public:
 	void clearTagBuffer();
 	void setClearTime(uint64_t time) { _last_clear_time = time; };
 	uint64_t getClearTime() { return _last_clear_time; };
+	void saveState(FILE* f);
+	void loadState(FILE* f);
 private:
 	void updateLRU(uint32_t set_num, uint32_t way);
 	TagBufferEntry ** _tag_buffer;
@@ -714,6 +778,68 @@ public:
    uint64_t dirty_bitvec; // whether a line is dirty in page
 };
 
+// Second level of the sector masks of a cached huge page: for each of the 64 chunks 
+// summarized by TLBEntry::touch_bitvec/dirty_bitvec, one bit per sector of the chunk.
+struct HugePageSectors
+{
+	uint64_t touch[64];
+	uint64_t dirty[64];
+};
+
+// Dirty page evicted from the DRAM cache, waiting to be written back to 
+// external memory. Dirty sectors of the same page are combined while queued.
+class WritebackEntry
+{
+public:
+	Address line_addr;      // first line of the page (or huge-page chunk)
+	uint64_t sector_mask;   // dirty sectors, same encoding as TLBEntry::dirty_bitvec
+	uint32_t sector_bursts; // bursts (16B) per dirty sector
+	bool cxl;               // external memory is accessed through cxl_access
+	uint64_t enqueue_cycle; // for the buffer residency stat
+
+	uint32_t getBursts() const { return __builtin_popcountll(sector_mask) * sector_bursts; };
+
+	// Whether any dirty sector holds a line in [addr, addr + lines)
+	bool overlaps(Address addr, uint32_t lines) const {
+		uint32_t sector_lines = std::max(sector_bursts / 4, 1u);
+		for (uint64_t mask = sector_mask; mask; mask &= mask - 1) {
+			Address start = line_addr + __builtin_ctzll(mask) * sector_lines;
+			if (start < addr + lines && addr < start + sector_lines)
+				return true;
+		}
+		return false;
+	}
+};
+
+// Breakdown of the controller counters by request source (core or process)
+class SourceBreakdown
+{
+public:
+	VectorCounter requests;
+	VectorCounter hits;
+	VectorCounter misses;
+	VectorCounter migrateBytes;  // data moved into the cache
+	VectorCounter metadataBytes; // tag/counter traffic
+	VectorCounter latency;       // sum of response - request cycles
+
+	void init(AggregateStat* parentStat, const char* name, const char* desc, uint32_t size);
+};
+
+// One sample of the controller interval time-series. Counts are deltas over the interval.
+struct IntervalSample
+{
+	uint64_t cycle;         // end of the interval
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t mcBytes;       // in-package (fast) memory traffic
+	uint64_t extBytes;      // external (far) memory traffic
+	uint64_t metadataBytes;
+	uint64_t migrateBytes;
+	uint32_t wbQueue;       // writeback buffer occupancy at the end of the interval
+};
+
+class PartMapper;
+class UMonMonitor;
 class LinePlacementPolicy;
 class PagePlacementPolicy;
 class OSPlacementPolicy;
@@ -723,7 +849,9 @@ class DDRMemory;
 
 class MemoryController : public MemObject {
 private:
-	DDRMemory * BuildDDRMemory(Config& config, uint32_t frequency, uint32_t domain, g_string name, const std::string& prefix, uint32_t tBL, double timing_scale);
+	MemObject * BuildDDRMemory(Config& config, uint32_t frequency, uint32_t domain, g_string name, const std::string& prefix, uint32_t tBL, double timing_scale,
+							   g_vector<DDRMemory*>& chans);
+	uint64_t getTierEnergy(const g_vector<DDRMemory*>& chans, uint32_t energyClass) const;
 	
 	g_string _name;
 
@@ -745,10 +873,14 @@ public:
 	MemObject ** _mcdram;
 	uint32_t _mcdram_per_mc;
 	g_string _mcdram_type;
+	bool _mcdram_hash; // permute channels with the XOR-folded upper address bits
+	// DDR channels of each tier (fast MC-Dram, far external memory), for energy stats
+	g_vector<DDRMemory*> _mcdram_chans;
+	g_vector<DDRMemory*> _ext_dram_chans;
+	VectorCounter _numMcdramAccess; // requests per MC-Dram channel
 
 	uint32_t _fm_size;
 	uint32_t _set_assoc;
-	g_vector<SDTree> sdtrees;
 	
 
 	// Trimma
@@ -821,6 +953,27 @@ private:
 
 	// TLB Hack
 	g_unordered_map <Address, TLBEntry> _tlb;
+
+	// Page geometry and touched/dirty sector masks. Pages of up to 64 sectors of 4 lines 
+	// (e.g., 4KB) keep one level in TLBEntry::touch_bitvec/dirty_bitvec. Huge pages (2MB) use 
+	// those as a 64-chunk summary, with per-chunk sector masks kept per cache frame 
+	// (set * ways + way); they are filled one sector at a time and only their dirty sectors 
+	// are written back.
+	uint32_t _page_lines;   // _granularity / 64
+	uint32_t _chunk_lines;  // lines per TLBEntry mask bit
+	uint32_t _leaf_lines;   // lines per sector (leaf mask bit)
+	bool _huge_page;
+	HugePageSectors * _huge_sectors;
+
+	uint64_t getFrame(uint64_t set_num, uint32_t way) { return set_num * _num_ways + way; };
+	void resetSectors(Address tag, uint64_t frame);
+	void markSector(Address tag, uint64_t frame, uint32_t line_idx, bool dirty);
+	bool isSectorTouched(Address tag, uint64_t frame, uint32_t line_idx);
+	uint32_t countSectorLines(Address tag, uint64_t frame, bool dirty);
+	uint32_t getTouchedLines(Address tag, uint64_t frame) { return countSectorLines(tag, frame, false); };
+	uint32_t getDirtyLines(Address tag, uint64_t frame) { return countSectorLines(tag, frame, true); };
+	uint64_t fetchSector(MemReq& req, Address tag, uint32_t line_idx, Address mc_address, uint32_t mcdram_select, bool cxl);
+	void writebackDirtySectors(MemReq& req, Address tag, uint64_t frame, Address mc_address, uint32_t mcdram_select, bool cxl, uint64_t cycle);
 	uint64_t _os_quantum;
 
     // Stats
@@ -856,13 +1009,106 @@ private:
    	uint64_t _num_miss_per_step;
 	uint64_t _mc_bw_per_step;
 	uint64_t _ext_bw_per_step;
-   	double _miss_rate_trace[MAX_STEPS];
 
-   	uint32_t _num_steps;
+	// Interval time-series, sampled every _interval_cycles (0 disables it). Samples go to a
+	// ring buffer that is appended to the CSV file when full and at the end of the simulation.
+	uint64_t _interval_cycles;
+	uint64_t _next_interval_cycle;
+	IntervalSample * _interval_buf;
+	uint32_t _interval_buf_size;
+	uint32_t _interval_head;  // oldest sample not yet written
+	uint32_t _interval_count;
+	g_string _interval_file;
+	IntervalSample _interval_last; // cumulative totals at the last sample
+	uint64_t _mc_bw_total;    // bursts; _*_bw_per_step decay, so increments are folded in here
+	uint64_t _ext_bw_total;
+	uint64_t _mc_bw_folded;   // _*_bw_per_step value already added to the totals
+	uint64_t _ext_bw_folded;
+
+	void decayStepStats();
+	void foldStepBandwidth();
+	void sampleInterval(uint64_t cycle);
+	void recordInterval(uint64_t cycle);
 
 	// to model the SRAM tag
 	bool 	_sram_tag;
 	uint32_t _llc_latency;
+
+	// Demand-sector fetch (BasicCache). Equal to _granularity when whole pages are fetched.
+	uint32_t _sector_size;
+	Counter _numSectorFill;
+	Counter _numSectorFetchBytes;
+	Counter _numSectorUsefulBytes;
+	Counter _numSectorWastedBytes;
+
+	void fillSector(Way& way, uint32_t line_idx, uint32_t sector_lines, bool fetched = true);
+	void touchLine(Way& way, uint32_t line_idx);
+	uint32_t getUntouchedLines(const Way& way);
+
+	// Eviction writeback buffer. With 0 entries, dirty pages are written back at eviction time.
+	g_vector<WritebackEntry> _wb_buffer; // FIFO, oldest first
+	uint32_t _wb_size;
+	uint32_t _wb_high_watermark;
+	uint32_t _wb_low_watermark;
+	uint64_t _wb_idle_cycles;   // far memory idle for this long -> drain one entry
+	uint64_t _ext_last_demand_cycle; // last external access, of any kind
+
+	Counter _numWbInsert;
+	Counter _numWbCombine;
+	Counter _numWbDrainFull;
+	Counter _numWbDrainHigh;
+	Counter _numWbDrainIdle;
+	Counter _numWbDrainConflict;
+	Counter _numWbCycles;
+	Counter _numWbBytes;
+
+	// Per-core (req.srcId) and per-process (procMask bits of the line address) breakdown.
+	// Hits and misses come from the class the demand path sets in _src_class; byte
+	// counter deltas since the last update are charged to the request holding _lock.
+	SourceBreakdown _coreStats;
+	SourceBreakdown _procStats;
+	uint8_t _src_class;
+	uint64_t _src_last_migrate;
+	uint64_t _src_last_metadata;
+
+	// End-to-end latency distributions. updateSourceStats() moves _src_class to
+	// _src_lat_class[srcId]; recordSourceLatency() hands it to probes around the request's
+	// timing record, which bin its weave-phase latency through recordLatency(). A request
+	// that caused metadata traffic is also counted as a hit or miss.
+	enum { SRC_HIT = 1, SRC_MISS = 2, SRC_METADATA = 4 };
+	uint8_t* _src_lat_class;
+	LatencyHistogram _latAll;
+	LatencyHistogram _latHit;
+	LatencyHistogram _latMiss;
+	LatencyHistogram _latMetadata;
+
+	void updateSourceStats(const MemReq& req);
+	void recordSourceLatency(const MemReq& req, uint64_t start_cycle, uint64_t resp_cycle);
+
+	// Way partitioning of the page-granularity schemes, disabled when _part_mapper is null.
+	// Replacement victims of a partition come from the ways it owns; empty ways are used by anyone.
+	PartMapper * _part_mapper;
+	UMonMonitor * _part_monitor;
+	lock_t _part_lock; // UMONs are updated outside _lock
+	uint32_t _num_partitions;
+	uint32_t _part_min_ways;
+	uint32_t * _part_ways;  // ways allocated to each partition
+	uint32_t * _way_part;   // partition owning each way
+	uint32_t * _page_part;  // partition that placed each cached page, per set and way
+	uint64_t * _part_pages; // cached pages per partition
+	Counter _numRepartitions;
+
+	uint32_t placePage(const MemReq& req, Address tag, ReqType type, uint64_t set_num, bool& counter_access);
+	void setPartitionWays(const uint32_t* allocs);
+
+	uint32_t selectMcdram(Address address);
+	void evictDirtyPage(MemReq& req, Address line_addr, Address mc_address, uint32_t mcdram_select, 
+						uint64_t sector_mask, uint32_t sector_bursts, bool cxl, uint64_t cycle);
+	void issueWriteback(MemReq& req, const WritebackEntry& entry, uint64_t cycle, int type);
+	void drainWriteback(MemReq& req, uint32_t num_entries, Counter& reason);
+	void updateWritebackBuffer(MemReq& req);
+	uint64_t extAccess(MemReq& req, int type, uint32_t data_size, bool cxl = false);
+	void drainConflict(MemReq& req, uint32_t idx);
 public:
 	MemoryController(g_string& name, uint32_t frequency, uint32_t domain, Config& config);
 	uint64_t access(MemReq& req);
@@ -874,8 +1120,21 @@ public:
 	uint64_t ideal_cache_access(MemReq& req);
 	uint64_t sdcache_access(MemReq& req);
 	uint64_t trimma_access(MemReq& req);
+	void functionalAccess(Address lineAddr, bool isStore);
+	void recordLatency(uint8_t cls, uint64_t lat);
+	void flushIntervals();
+	void repartition(); // lookahead reallocation from the UMON miss curves, every partInterval phases
+	uint32_t getWayPartition(uint32_t way) { return _way_part[way]; };
 	const char * getName() { return _name.c_str(); };
 	void initStats(AggregateStat* parentStat); 
+
+	/**
+	 * @brief Checkpoint/restore of the functional DRAM cache state (tags, page table, 
+	 *        placement counters, tag buffer, Trimma remap structures), so that long 
+	 *        warm-ups can be skipped. Timing state and stats are not saved.
+	 */
+	void saveWarmState(FILE* f);
+	void loadWarmState(FILE* f);
 	
 	/**
 	 * @brief 求log2x
@@ -890,4 +1149,8 @@ public:
 	//using GlobAlloc::operator delete;
 };
 
+// Save/restore all DRAM cache controllers (zinfo->dramCaches) to/from one file
+void SaveDramCacheWarmState(const char* file);
+void LoadDramCacheWarmState(const char* file);
+
 #endif
\ No newline at end of file
@@ -110,6 +110,7 @@ MD1Memory::MD1Memory(uint32_t requestSize, uint32_t megacyclesPerSecond, uint32_
     : zeroLoadLatency(_zeroLoadLatency), name(_name)
 {
     lastPhase = 0;
+    lastPhaseCycles = 0;
 
     double bytesPerCycle = ((double)megabytesPerSecond)/((double)megacyclesPerSecond);
     maxRequestsPerCycle = bytesPerCycle/requestSize;
@@ -125,7 +126,7 @@ MD1Memory::MD1Memory(uint32_t requestSize, uint32_t megacyclesPerSecond, uint32_
 }
 
 void MD1Memory::updateLatency() {
-    uint32_t phaseCycles = (zinfo->numPhases - lastPhase)*(zinfo->phaseLength);
+    uint64_t phaseCycles = zinfo->globPhaseCycles - lastPhaseCycles;  // phases may differ in length
     if (phaseCycles < 10000) return; //Skip with short phases
 
     smoothedPhaseAccesses =  (curPhaseAccesses*0.5) + (smoothedPhaseAccesses*0.5);
@@ -149,6 +150,7 @@ void MD1Memory::updateLatency() {
 
     curPhaseAccesses = 0;
     __sync_synchronize();
+    lastPhaseCycles = zinfo->globPhaseCycles;
     lastPhase = zinfo->numPhases;
 }
 
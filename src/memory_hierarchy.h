@@ -97,11 +97,17 @@ struct MemReq {
         NONINCLWB     = (1<<3), //This is a non-inclusive writeback. Do not assume that the line was in the lower level. Used on NUCA (BankDir).
         PUTX_KEEPEXCL = (1<<4), //Non-relinquishing PUTX. On a PUTX, maintain the requestor's E state instead of removing the sharer (i.e., this is a pure writeback)
         PREFETCH      = (1<<5), //Prefetch GETS access. Only set at level where prefetch is issued; handled early in MESICC
+        DRAM_DEMAND    = (1<<6), //DRAM cache traffic classes, set by MemoryController on the requests it sends to its memories.
+        DRAM_METADATA  = (1<<7), //Only DDRMemory reads them, to split its energy by class; with none set, it guesses from the access.
+        DRAM_MIGRATION = (1<<8),
     };
+    static const uint32_t DRAM_CLASSES = DRAM_DEMAND | DRAM_METADATA | DRAM_MIGRATION;
     uint32_t flags;
 
     inline void set(Flag f) {flags |= f;}
     inline bool is (Flag f) const {return flags & f;}
+    inline void setDramClass(Flag f) {flags = (flags & ~DRAM_CLASSES) | f;}
+    inline uint32_t dramClassFlags(Flag f) const {return (flags & ~DRAM_CLASSES) | f;}
 };
 
 /* Invalidation/downgrade request */
@@ -129,6 +135,8 @@ class MemObject : public GlobAlloc {
         // Warning if not use DDR Type, add by Jiahao Lu
         virtual uint64_t rd_dram_tag_latency(MemReq& req, uint32_t data_size){assert(false); };
         virtual uint64_t wt_dram_tag_latency(MemReq& req, uint32_t data_size){assert(false); };
+        // Functional-only access (no timing, events or stats), used to warm up memory-side caches in fast-forward
+        virtual void functionalAccess(Address lineAddr, bool isStore) {}
         virtual void initStats(AggregateStat* parentStat) {}
         virtual const char* getName() = 0;
 };
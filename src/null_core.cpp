@@ -41,7 +41,7 @@ void NullCore::initStats(AggregateStat* parentStat) {
 }
 
 uint64_t NullCore::getPhaseCycles() const {
-    return curCycle - zinfo->globPhaseCycles;
+    return (curCycle > zinfo->globPhaseCycles)? curCycle - zinfo->globPhaseCycles : 0;
 }
 
 void NullCore::bbl(BblInfo* bblInfo) {
@@ -73,7 +73,7 @@ void NullCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
 
     while (unlikely(core->curCycle > core->phaseEndCycle)) {
         assert(core->phaseEndCycle == zinfo->globPhaseCycles + zinfo->phaseLength);
-        core->phaseEndCycle += zinfo->phaseLength;
+        core->phaseEndCycle += zinfo->nextPhaseLength;
 
         uint32_t cid = getCid(tid);
         //NOTE: TakeBarrier may take ownership of the core, and so it will be used by some other thread. If TakeBarrier context-switches us,
@@ -117,7 +117,7 @@ void OOOCore::initStats(AggregateStat* parentStat) {
 }
 
 uint64_t OOOCore::getInstrs() const {return instrs;}
-uint64_t OOOCore::getPhaseCycles() const {return curCycle % zinfo->phaseLength;}
+uint64_t OOOCore::getPhaseCycles() const {return (curCycle > zinfo->globPhaseCycles)? curCycle - zinfo->globPhaseCycles : 0;}
 
 void OOOCore::contextSwitch(int32_t gid) {
     if (gid == -1) {
@@ -504,7 +504,7 @@ void OOOCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
     core->bbl(bblAddr, bblInfo);
 
     while (core->curCycle > core->phaseEndCycle) {
-        core->phaseEndCycle += zinfo->phaseLength;
+        core->phaseEndCycle += zinfo->nextPhaseLength;
 
         uint32_t cid = getCid(tid);
         // NOTE: TakeBarrier may take ownership of the core, and so it will be used by some other thread. If TakeBarrier context-switches us,
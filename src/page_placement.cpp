@@ -2,6 +2,7 @@
 #include "mc.h"
 #include <stdlib.h>
 #include <iostream>
+#include <algorithm>
 
 void
 PagePlacementPolicy::initialize(Config & config)
@@ -9,6 +10,17 @@ PagePlacementPolicy::initialize(Config & config)
 	_num_chunks = _mc->getNumSets();
 	_chunks = (ChunkInfo *) gm_malloc(sizeof(ChunkInfo) *  _num_chunks);
 	
+	g_string scheme = config.get<const char *>("sys.mem.mcdram.placementPolicy");
+	// hyrbid
+	if (scheme == "LRU")
+		_placement_policy = LRU;
+	else if (scheme == "FBR")
+		_placement_policy = FBR;
+	else if (scheme == "PRR")
+		_placement_policy = PRR;
+	else 
+		assert(false);
+
 	_scheme = _mc->getScheme();
 	_sample_rate = config.get<double>("sys.mem.mcdram.sampleRate");
     _enable_replace = config.get<bool>("sys.mem.mcdram.enableReplace", true); 
@@ -21,40 +33,113 @@ PagePlacementPolicy::initialize(Config & config)
 
 	_num_entries_per_chunk = 129; //g_num_entries_per_chunk;
 	//_num_stable_entries = _num_entries_per_chunk / 2;
-	assert(_num_entries_per_chunk > _mc->getNumWays());
+	assert(_num_entries_per_chunk > _mc->getNumWays() && _num_entries_per_chunk < NO_ENTRY);
+	// tag index at most 2/3 full
+	_index_bits = 1;
+	while ((1u << _index_bits) < _num_entries_per_chunk * 3 / 2)
+		_index_bits++;
+	_index_size = 1u << _index_bits;
 	for (uint64_t i = 0; i < _num_chunks; i++)
 	{
 		_chunks[i].num_hits = 0;
 		_chunks[i].num_misses = 0;
+		// only FBR keeps the per-chunk counter tables
+		_chunks[i].entries = NULL;
+		_chunks[i].index = _chunks[i].heap = _chunks[i].heap_pos = NULL;
+		if (_placement_policy != FBR)
+			continue;
 		_chunks[i].entries = (ChunkEntry *) gm_malloc(sizeof(ChunkEntry) * _num_entries_per_chunk);
 		for (uint32_t j = 0; j < _num_entries_per_chunk; j++)
-			_chunks[i].entries[j].valid = false;
+			_chunks[i].entries[j] = ChunkEntry{false, 0, 0};
+		_chunks[i].index = (uint16_t *) gm_malloc(sizeof(uint16_t) * _index_size);
+		_chunks[i].heap = (uint16_t *) gm_malloc(sizeof(uint16_t) * _mc->getNumWays());
+		_chunks[i].heap_pos = (uint16_t *) gm_malloc(sizeof(uint16_t) * _mc->getNumWays());
+		rebuildChunk(&_chunks[i]);
 	}
 	_histogram = NULL;
 	srand48_r(rand(), &_buffer);
 	clearStats();
 
-	g_string scheme = config.get<const char *>("sys.mem.mcdram.placementPolicy");
 	_lru_bits = (uint32_t **) gm_malloc(sizeof(uint32_t *) * _mc->getNumSets());
 	for (uint64_t i = 0; i < _mc->getNumSets(); i++) {
 		_lru_bits[i] = (uint32_t *) gm_malloc(sizeof(uint32_t) * _mc->getNumWays()); 
 		for (uint32_t j = 0; j < _mc->getNumWays(); j++)
 			_lru_bits[i][j] = j;
 	}
-	// hyrbid
-	if (scheme == "LRU")
-		_placement_policy = LRU;
-	else if (scheme == "FBR")
-		_placement_policy = FBR;
-	else if (scheme == "PRR")
-		_placement_policy = PRR;
-	else 
-		assert(false);
+
+	// PRR: hits bump the page counter with prrProbability; all counters halve every 
+	// prrDecayInterval misses (default: one miss per frame). Victims are the coldest 
+	// of prrCandidates randomly sampled ways.
+	_prr_probability = config.get<double>("sys.mem.mcdram.prrProbability", 0.125);
+	_prr_decay_interval = config.get<uint64_t>("sys.mem.mcdram.prrDecayInterval", _mc->getNumSets() * _mc->getNumWays());
+	_prr_candidates = config.get<uint32_t>("sys.mem.mcdram.prrCandidates", 4);
+	assert(_prr_probability > 0 && _prr_probability <= 1);
+	assert(_prr_decay_interval > 0 && _prr_candidates > 0);
+	_prr_epoch = 0;
+	_prr_misses = 0;
+	_prr_counters = NULL;
+	if (_placement_policy == PRR) {
+		uint64_t num_frames = _mc->getNumSets() * _mc->getNumWays();
+		_prr_counters = (PrrCounter *) gm_malloc(sizeof(PrrCounter) * num_frames);
+		for (uint64_t i = 0; i < num_frames; i++)
+			_prr_counters[i] = PrrCounter{0, 0};
+	}
+}
+
+
+void
+PagePlacementPolicy::saveState(FILE* f)
+{
+	uint32_t policy = _placement_policy;
+	writeWarmState(f, &policy);
+	writeWarmState(f, &_num_chunks);
+	writeWarmState(f, &_num_entries_per_chunk);
+	for (uint64_t i = 0; i < _num_chunks; i++) {
+		writeWarmState(f, &_chunks[i].access_count);
+		writeWarmState(f, &_chunks[i].num_hits);
+		writeWarmState(f, &_chunks[i].num_misses);
+		if (_placement_policy == FBR)
+			writeWarmState(f, _chunks[i].entries, _num_entries_per_chunk);
+		writeWarmState(f, _lru_bits[i], _mc->getNumWays());
+	}
+	if (_placement_policy == PRR) {
+		writeWarmState(f, &_prr_epoch);
+		writeWarmState(f, &_prr_misses);
+		writeWarmState(f, _prr_counters, _mc->getNumSets() * _mc->getNumWays());
+	}
 }
 
+void
+PagePlacementPolicy::loadState(FILE* f)
+{
+	uint32_t policy;
+	uint64_t num_chunks;
+	uint32_t num_entries;
+	readWarmState(f, &policy);
+	readWarmState(f, &num_chunks);
+	readWarmState(f, &num_entries);
+	if (policy != (uint32_t)_placement_policy || num_chunks != _num_chunks || num_entries != _num_entries_per_chunk)
+		panic("Placement policy warm state mismatch: policy %d, %ld chunks x %d entries, expected %d, %ld x %d", 
+			policy, num_chunks, num_entries, _placement_policy, _num_chunks, _num_entries_per_chunk);
+	for (uint64_t i = 0; i < _num_chunks; i++) {
+		readWarmState(f, &_chunks[i].access_count);
+		readWarmState(f, &_chunks[i].num_hits);
+		readWarmState(f, &_chunks[i].num_misses);
+		if (_placement_policy == FBR) {
+			readWarmState(f, _chunks[i].entries, _num_entries_per_chunk);
+			rebuildChunk(&_chunks[i]);
+		}
+		readWarmState(f, _lru_bits[i], _mc->getNumWays());
+	}
+	if (_placement_policy == PRR) {
+		readWarmState(f, &_prr_epoch);
+		readWarmState(f, &_prr_misses);
+		readWarmState(f, _prr_counters, _mc->getNumSets() * _mc->getNumWays());
+	}
+}
 
 uint32_t 
-PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num, Set * set, bool &counter_access)
+PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num, Set * set, bool &counter_access, uint32_t part)
 {
 	uint64_t chunk_num = set_num;
 	//ChunkInfo * chunk = &_chunks[chunk_num];
@@ -75,42 +160,31 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 	  	lrand48_r(&_buffer, &way);
 		if (f < _sample_rate) {
 			//if (_scheme == UnisonCache) {
-				for (uint32_t i = 0; i < _mc->getNumWays(); i++)
-					if (_lru_bits[set_num][i] == _mc->getNumWays() - 1) {
-						Address victim_tag = set->ways[i].tag;
-						if (_scheme == HybridCache) {
-							if (_mc->getTagBuffer()->canInsert(tag, victim_tag)) {
-								updateLRU(set_num, i);
-								return i;
-							} else 
-								return _mc->getNumWays();
-						} else { 
-							updateLRU(set_num, i);
-							return i;
-						}
-					}
+				uint32_t i = getLRUWay(set_num, part);
+				Address victim_tag = set->ways[i].tag;
+				if (_scheme == HybridCache) {
+					if (_mc->getTagBuffer()->canInsert(tag, victim_tag)) {
+						updateLRU(set_num, i);
+						return i;
+					} else 
+						return _mc->getNumWays();
+				} else { 
+					updateLRU(set_num, i);
+					return i;
+				}
 			//} else 
 			//	return way % _mc->getNumWays();
 		} else 
 			return _mc->getNumWays();
 	}
+	if (_placement_policy == PRR)
+		return handlePrrMiss(tag, set_num, set, counter_access, part);
 	assert(_placement_policy == FBR);
 	assert(_enable_replace);
 
-#if 1
 	ChunkInfo * chunk = &_chunks[chunk_num];
-	for (uint32_t way = 0; way < _mc->getNumWays(); way++)
-		if (set->ways[way].valid) {
-			if (set->ways[way].tag != _chunks[chunk_num].entries[way].tag)
-			{
-				for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
-					printf("ID=%d, tag=%ld, valid=%d, count=%d\n", 
-						i, chunk->entries[i].tag, chunk->entries[i].valid, chunk->entries[i].count);
-				for (uint32_t i = 0; i < _mc->getNumWays(); i++)
-					printf("ID=%d, tag=%ld\n", i, set->ways[i].tag);
-			}
-			assert(set->ways[way].tag == _chunks[chunk_num].entries[way].tag);
-		}
+#ifdef FBR_DEBUG
+	verifyChunk(chunk, set);
 #endif 
 
 	// for HybridCache, never replace for store (LLC dirty evict) 
@@ -132,13 +206,15 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 		counter_access = true;
 		_num_counter_read ++;
 		_num_counter_write ++;
-		uint32_t idx = getChunkEntry(tag, &_chunks[chunk_num]);
+		uint32_t idx = getChunkEntry(tag, chunk);
 		if (idx == _num_entries_per_chunk)
 			return _mc->getNumWays();
-		ChunkEntry * chunk_entry = &_chunks[chunk_num].entries[idx];
+		ChunkEntry * chunk_entry = &chunk->entries[idx];
 		chunk_entry->count ++;
 		if (chunk_entry->count >= _max_count_size) 
-			handleCounterOverflow(&_chunks[chunk_num], chunk_entry);
+			handleCounterOverflow(chunk, chunk_entry);
+		else if (idx < _mc->getNumWays())
+			fixHeap(chunk, idx);
 		
 		//idx = adjustEntryOrder(&_chunks[chunk_num], idx);
 		//chunk_entry = &_chunks[chunk_num].entries[idx];
@@ -152,7 +228,7 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 		else // figure if we can replace an entry. 
 		{
 			assert(idx >= _mc->getNumWays());
-			uint32_t victim_way = pickVictimWay(&_chunks[chunk_num]);
+			uint32_t victim_way = pickVictimWay(&_chunks[chunk_num], part);
 			assert(victim_way < _mc->getNumWays());
 /*			if (compareCounter(&_chunks[chunk_num].entries[idx], &_chunks[chunk_num].entries[victim_way]) && !_mc->getTagBuffer()->canInsert(tag, _chunks[chunk_num].entries[victim_way].tag)) 
 			{
@@ -167,9 +243,11 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 			{
 				//assert(idx < _num_stable_entries);
 				// swap current way with victim way.
-				ChunkEntry tmp = _chunks[chunk_num].entries[idx];
-				_chunks[chunk_num].entries[idx] = _chunks[chunk_num].entries[victim_way];
-				_chunks[chunk_num].entries[victim_way] = tmp;
+				uint32_t slot = findIndexSlot(chunk, chunk->entries[idx].tag);
+				uint32_t victim_slot = findIndexSlot(chunk, chunk->entries[victim_way].tag);
+				std::swap(chunk->entries[idx], chunk->entries[victim_way]);
+				std::swap(chunk->index[slot], chunk->index[victim_slot]);
+				fixHeap(chunk, victim_way);
 				//assert(idx >= _mc->getNumWays() && idx < _num_stable_entries);
 				return victim_way;
 			} 
@@ -190,23 +268,23 @@ PagePlacementPolicy::handleCacheHit(Address tag, ReqType type, uint64_t set_num,
 			updateLRU(set_num, hit_way);
 		return;
 	}
+	if (_placement_policy == PRR) {
+		double f;
+		drand48_r(&_buffer, &f);
+		if (f < _prr_probability) {
+			counter_access = true;
+			_num_counter_read ++;
+			_num_counter_write ++;
+			uint32_t count = getPrrCount(set_num, hit_way);
+			if (count < PRR_MAX_COUNT)
+				_prr_counters[set_num * _mc->getNumWays() + hit_way].count = count + 1;
+		}
+		return;
+	}
 	uint64_t chunk_num = set_num;
 	ChunkInfo * chunk = &_chunks[chunk_num];
-#if 1
-	// for DEBUG
-	// the first few entries in chunk->entries must be in dram cache
-	for (uint32_t way = 0; way < _mc->getNumWays(); way++)
-		if (set->ways[way].valid) {
-			if (set->ways[way].tag != _chunks[chunk_num].entries[way].tag)
-			{
-				for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
-					printf("ID=%d, tag=%ld, valid=%d, count=%d\n", 
-						i, chunk->entries[i].tag, chunk->entries[i].valid, chunk->entries[i].count);
-				for (uint32_t i = 0; i < _mc->getNumWays(); i++)
-					printf("ID=%dm tag=%ld\n", i, set->ways[i].tag);
-			}
-			assert(set->ways[way].tag == _chunks[chunk_num].entries[way].tag);
-		}
+#ifdef FBR_DEBUG
+	verifyChunk(chunk, set);
 	// chunk->entries are properly ordered.
 	/*uint32_t min_count = 10000;
 	for (uint32_t way = 0; way < _num_stable_entries; way++)
@@ -234,27 +312,26 @@ PagePlacementPolicy::handleCacheHit(Address tag, ReqType type, uint64_t set_num,
 		counter_access = true;
 		_num_counter_read ++;
 		_num_counter_write ++;
-		uint32_t idx = getChunkEntry(tag, &_chunks[chunk_num]);
-		ChunkEntry * chunk_entry = &_chunks[chunk_num].entries[idx];
+		uint32_t idx = getChunkEntry(tag, chunk);
+		ChunkEntry * chunk_entry = &chunk->entries[idx];
 		assert(idx < _mc->getNumWays()); 
 		chunk_entry->count ++;
 		//assert( idx == adjustEntryOrder(&_chunks[chunk_num], idx ));
 		if (chunk_entry->count >= _max_count_size) 
-			handleCounterOverflow(&_chunks[chunk_num], chunk_entry);
+			handleCounterOverflow(chunk, chunk_entry);
+		else
+			fixHeap(chunk, idx);
 	}
 }
 
 uint32_t
 PagePlacementPolicy::getChunkEntry(Address tag, ChunkInfo * chunk_info, bool allocate)
 {
-	uint32_t idx = _num_entries_per_chunk; 
-	for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
-	{
-		if (chunk_info->entries[i].valid && chunk_info->entries[i].tag == tag)
-			return i; //&chunk_info->entries[i];
-		else if (!chunk_info->entries[i].valid && idx == _num_entries_per_chunk) 
-			idx = i; 
-	}
+	uint32_t slot = findIndexSlot(chunk_info, tag);
+	if (chunk_info->index[slot] != NO_ENTRY)
+		return chunk_info->index[slot];
+	// first invalid entry, if any
+	uint32_t idx = chunk_info->num_valid;
 	if (idx == _num_entries_per_chunk && allocate) 
 	{
 	  	int64_t rand;
@@ -270,9 +347,17 @@ PagePlacementPolicy::getChunkEntry(Address tag, ChunkInfo * chunk_info, bool all
 			idx = _num_entries_per_chunk;
 	}
 	if (idx < _num_entries_per_chunk) {
+		if (chunk_info->entries[idx].valid) {
+			eraseIndexSlot(chunk_info, findIndexSlot(chunk_info, chunk_info->entries[idx].tag));
+			slot = findIndexSlot(chunk_info, tag);
+		} else
+			chunk_info->num_valid++;
 		chunk_info->entries[idx].valid = true; 
 		chunk_info->entries[idx].tag = tag; 
 		chunk_info->entries[idx].count = 0;
+		chunk_info->index[slot] = idx;
+		if (idx < _mc->getNumWays())
+			fixHeap(chunk_info, idx);
 	}
 	return idx;
 }
@@ -336,13 +421,19 @@ PagePlacementPolicy::adjustEntryOrder(ChunkInfo * chunk_info, uint32_t idx)
 }
 
 uint32_t 
-PagePlacementPolicy::pickVictimWay(ChunkInfo * chunk_info)
+PagePlacementPolicy::pickVictimWay(ChunkInfo * chunk_info, uint32_t part)
 {
+	if (part == NO_PARTITION) {
+		assert(chunk_info->entries[chunk_info->heap[0]].valid);
+		return chunk_info->heap[0];
+	}
 	uint32_t min_count = 10000;
 	uint32_t min_idx = _mc->getNumWays();
 	for (uint32_t i = 0; i < _mc->getNumWays(); i++)
 	{
 		assert(chunk_info->entries[i].valid);
+		if (part != NO_PARTITION && _mc->getWayPartition(i) != part)
+			continue;
 		if (chunk_info->entries[i].count < min_count)
 		{
 			min_count = chunk_info->entries[i].count;
@@ -352,6 +443,106 @@ PagePlacementPolicy::pickVictimWay(ChunkInfo * chunk_info)
 	return min_idx;
 }
 
+// PRR miss: a new page fills an empty way, otherwise replaces the sampled victim with 
+// probability sampleRate / (1 + victim count), so hot pages are rarely displaced
+uint32_t
+PagePlacementPolicy::handlePrrMiss(Address tag, uint64_t set_num, Set * set, bool &counter_access, uint32_t part)
+{
+	if (++_prr_misses % _prr_decay_interval == 0)
+		_prr_epoch ++;
+	if (set->hasEmptyWay()) {
+		uint32_t empty_way = set->getEmptyWay();
+		resetPrrCounter(set_num, empty_way);
+		_num_empty_replace ++;
+		return empty_way;
+	}
+	if (!_enable_replace)
+		return _mc->getNumWays();
+
+	counter_access = true;
+	_num_counter_read ++;
+	uint32_t victim_way = pickPrrVictim(set_num, part);
+	double f;
+	drand48_r(&_buffer, &f);
+	if (f * (1 + getPrrCount(set_num, victim_way)) >= _sample_rate)
+		return _mc->getNumWays();
+	if (_scheme == HybridCache && !_mc->getTagBuffer()->canInsert(tag, set->ways[victim_way].tag))
+		return _mc->getNumWays();
+	_num_counter_write ++;
+	resetPrrCounter(set_num, victim_way);
+	return victim_way;
+}
+
+// Coldest of _prr_candidates random ways of the partition. Falls back to a scan if 
+// the random draws keep missing a small partition.
+uint32_t
+PagePlacementPolicy::pickPrrVictim(uint64_t set_num, uint32_t part)
+{
+	uint32_t num_ways = _mc->getNumWays();
+	uint32_t victim_way = num_ways;
+	uint32_t min_count = PRR_MAX_COUNT + 1;
+	uint32_t sampled = 0;
+	for (uint32_t tries = 0; sampled < _prr_candidates && tries < 4 * _prr_candidates; tries++) {
+		int64_t rand;
+		lrand48_r(&_buffer, &rand);
+		uint32_t way = rand % num_ways;
+		if (part != NO_PARTITION && _mc->getWayPartition(way) != part)
+			continue;
+		sampled ++;
+		uint32_t count = getPrrCount(set_num, way);
+		if (count < min_count) {
+			min_count = count;
+			victim_way = way;
+		}
+	}
+	if (victim_way == num_ways) {
+		for (uint32_t way = 0; way < num_ways; way++) {
+			if (part != NO_PARTITION && _mc->getWayPartition(way) != part)
+				continue;
+			uint32_t count = getPrrCount(set_num, way);
+			if (count < min_count) {
+				min_count = count;
+				victim_way = way;
+			}
+		}
+	}
+	assert(victim_way < num_ways);
+	return victim_way;
+}
+
+// Counter of a cached page, after applying the decay epochs it missed
+uint32_t
+PagePlacementPolicy::getPrrCount(uint64_t set_num, uint32_t way)
+{
+	PrrCounter& counter = _prr_counters[set_num * _mc->getNumWays() + way];
+	uint32_t elapsed = _prr_epoch - counter.epoch;
+	counter.count = (elapsed >= 8)? 0 : counter.count >> elapsed;
+	counter.epoch = _prr_epoch;
+	return counter.count;
+}
+
+// A newly placed page starts with the access that brought it in
+void
+PagePlacementPolicy::resetPrrCounter(uint64_t set_num, uint32_t way)
+{
+	_prr_counters[set_num * _mc->getNumWays() + way] = PrrCounter{_prr_epoch, 1};
+}
+
+// Least recently used way, among the ways of the partition
+uint32_t
+PagePlacementPolicy::getLRUWay(uint64_t set_num, uint32_t part)
+{
+	uint32_t lru_way = _mc->getNumWays();
+	for (uint32_t i = 0; i < _mc->getNumWays(); i++) {
+		if (part != NO_PARTITION && _mc->getWayPartition(i) != part)
+			continue;
+		if (lru_way == _mc->getNumWays() || _lru_bits[set_num][i] > _lru_bits[set_num][lru_way])
+			lru_way = i;
+	}
+	assert(lru_way < _mc->getNumWays());
+	return lru_way;
+}
+
 void 
 PagePlacementPolicy::handleCounterOverflow(ChunkInfo * chunk_info, ChunkEntry * overflow_entry)
 {
@@ -362,6 +553,122 @@ PagePlacementPolicy::handleCounterOverflow(ChunkInfo * chunk_info, ChunkEntry *
 		else 
 			chunk_info->entries[i].count /= 2;
 	}
+	// halving can reorder ways of close counts
+	rebuildHeap(chunk_info);
+}
+
+// Slot holding tag, or the empty slot ending its probe sequence
+uint32_t
+PagePlacementPolicy::findIndexSlot(ChunkInfo * chunk_info, Address tag)
+{
+	uint32_t slot = getIndexSlot(tag);
+	while (chunk_info->index[slot] != NO_ENTRY && chunk_info->entries[chunk_info->index[slot]].tag != tag)
+		slot = (slot + 1) & (_index_size - 1);
+	return slot;
+}
+
+// Backward-shift deletion, so lookups never need tombstones
+void
+PagePlacementPolicy::eraseIndexSlot(ChunkInfo * chunk_info, uint32_t slot)
+{
+	uint32_t mask = _index_size - 1;
+	assert(chunk_info->index[slot] != NO_ENTRY);
+	uint32_t hole = slot;
+	for (uint32_t next = (hole + 1) & mask; chunk_info->index[next] != NO_ENTRY; next = (next + 1) & mask) {
+		uint32_t home = getIndexSlot(chunk_info->entries[chunk_info->index[next]].tag);
+		if (((next - home) & mask) >= ((next - hole) & mask)) {
+			chunk_info->index[hole] = chunk_info->index[next];
+			hole = next;
+		}
+	}
+	chunk_info->index[hole] = NO_ENTRY;
+}
+
+// Ties go to the lower way, as in a linear scan for the minimum
+bool
+PagePlacementPolicy::heapLess(ChunkInfo * chunk_info, uint32_t way1, uint32_t way2)
+{
+	uint32_t count1 = chunk_info->entries[way1].count;
+	uint32_t count2 = chunk_info->entries[way2].count;
+	return count1 < count2 || (count1 == count2 && way1 < way2);
+}
+
+// Restores the heap after the count of way changed
+void
+PagePlacementPolicy::fixHeap(ChunkInfo * chunk_info, uint32_t way)
+{
+	uint32_t num_ways = _mc->getNumWays();
+	uint16_t * heap = chunk_info->heap;
+	uint32_t pos = chunk_info->heap_pos[way];
+	while (pos > 0 && heapLess(chunk_info, way, heap[(pos - 1) / 2])) {
+		heap[pos] = heap[(pos - 1) / 2];
+		chunk_info->heap_pos[heap[pos]] = pos;
+		pos = (pos - 1) / 2;
+	}
+	while (2 * pos + 1 < num_ways) {
+		uint32_t child = 2 * pos + 1;
+		if (child + 1 < num_ways && heapLess(chunk_info, heap[child + 1], heap[child]))
+			child++;
+		if (!heapLess(chunk_info, heap[child], way))
+			break;
+		heap[pos] = heap[child];
+		chunk_info->heap_pos[heap[pos]] = pos;
+		pos = child;
+	}
+	heap[pos] = way;
+	chunk_info->heap_pos[way] = pos;
+}
+
+void
+PagePlacementPolicy::rebuildHeap(ChunkInfo * chunk_info)
+{
+	uint32_t num_ways = _mc->getNumWays();
+	for (uint32_t i = 0; i < num_ways; i++)
+		chunk_info->heap[i] = i;
+	// a sorted array is a valid heap
+	std::sort(chunk_info->heap, chunk_info->heap + num_ways, 
+		[&](uint16_t a, uint16_t b) { return heapLess(chunk_info, a, b); });
+	for (uint32_t i = 0; i < num_ways; i++)
+		chunk_info->heap_pos[chunk_info->heap[i]] = i;
+}
+
+void
+PagePlacementPolicy::rebuildChunk(ChunkInfo * chunk_info)
+{
+	for (uint32_t i = 0; i < _index_size; i++)
+		chunk_info->index[i] = NO_ENTRY;
+	chunk_info->num_valid = 0;
+	while (chunk_info->num_valid < _num_entries_per_chunk && chunk_info->entries[chunk_info->num_valid].valid) {
+		uint32_t idx = chunk_info->num_valid++;
+		chunk_info->index[findIndexSlot(chunk_info, chunk_info->entries[idx].tag)] = idx;
+	}
+	for (uint32_t i = chunk_info->num_valid; i < _num_entries_per_chunk; i++)
+		assert(!chunk_info->entries[i].valid);
+	rebuildHeap(chunk_info);
+}
+
+// FBR_DEBUG: the ways of the set must match the first chunk entries, and the index and heap the entries
+void
+PagePlacementPolicy::verifyChunk(ChunkInfo * chunk, Set * set)
+{
+	for (uint32_t way = 0; way < _mc->getNumWays(); way++)
+		if (set->ways[way].valid) {
+			if (set->ways[way].tag != chunk->entries[way].tag)
+			{
+				for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
+					printf("ID=%d, tag=%ld, valid=%d, count=%d\n", 
+						i, chunk->entries[i].tag, chunk->entries[i].valid, chunk->entries[i].count);
+				for (uint32_t i = 0; i < _mc->getNumWays(); i++)
+					printf("ID=%d, tag=%ld\n", i, set->ways[i].tag);
+			}
+			assert(set->ways[way].tag == chunk->entries[way].tag);
+		}
+	for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
+		assert(chunk->entries[i].valid == (i < chunk->num_valid));
+	for (uint32_t i = 0; i < chunk->num_valid; i++)
+		assert(chunk->index[findIndexSlot(chunk, chunk->entries[i].tag)] == i);
+	for (uint32_t i = 1; i < _mc->getNumWays(); i++)
+		assert(!heapLess(chunk, chunk->heap[i], chunk->heap[(i - 1) / 2]));
 }
 
 void 
@@ -423,10 +730,13 @@ PagePlacementPolicy::updateLRU(uint64_t set_num, uint32_t way_num)
 void 
 PagePlacementPolicy::flushChunk(uint32_t set)
 {
+	if (_placement_policy != FBR)
+		return;
 	for (uint32_t i = 0; i < _num_entries_per_chunk; i ++) {
 		_chunks[set].entries[i].valid = false; 
 		_chunks[set].entries[i].tag = 0; 
 		_chunks[set].entries[i].count = 0; 
 	}	
+	rebuildChunk(&_chunks[set]);
 }
 
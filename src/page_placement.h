@@ -6,8 +6,6 @@
 class Way;
 class Set; 
 class DramCache;
-class SDTree;
-class SDLNode;
 
 class PagePlacementPolicy
 {
@@ -18,10 +16,12 @@ public:
 		FBR = 1,
 		PRR = 2,
 	};
+	static const uint32_t NO_PARTITION = (uint32_t)-1;
 
 	PagePlacementPolicy(MemoryController * mc) : _mc(mc) {};
 	void initialize(Config & config);
-	uint32_t handleCacheMiss(Address tag, ReqType type, uint64_t set_num, Set * set, bool &counter_access);
+	// part: way partition of the request (victims only come from its ways), or NO_PARTITION
+	uint32_t handleCacheMiss(Address tag, ReqType type, uint64_t set_num, Set * set, bool &counter_access, uint32_t part = NO_PARTITION);
 	void handleCacheHit(Address tag, ReqType type, uint64_t set_num, Set * set, bool &counter_access, uint32_t hit_way);
 
 	
@@ -29,6 +29,9 @@ public:
 	void flushChunk(uint32_t set);
 	void clearStats(); 
 	RepScheme get_placement_policy() { return _placement_policy; }
+	// Warm-state checkpoint of the FBR chunk counters, PRR counters and LRU bits
+	void saveState(FILE* f);
+	void loadState(FILE* f);
 private:
 	MemoryController * _mc;
 	struct ChunkEntry 
@@ -43,14 +46,44 @@ private:
 		ChunkEntry * entries;
 		uint64_t num_hits;
 		uint64_t num_misses;
+		// Entries are allocated in order and only invalidated by flushChunk, so 
+		// entries [num_valid, _num_entries_per_chunk) are the invalid ones.
+		uint32_t num_valid;
+		uint16_t * index;    // open-addressed (linear probing) tag -> entry, NO_ENTRY if empty
+		uint16_t * heap;     // min-heap of the ways, ordered by (count, way)
+		uint16_t * heap_pos; // position of each way in heap
 	};
+	static const uint16_t NO_ENTRY = (uint16_t)-1;
+	// PRR: a saturating hit counter per cached page, halved once per elapsed decay epoch. 
+	// The decay is applied lazily when the counter is next read.
+	struct PrrCounter
+	{
+		uint32_t epoch;
+		uint8_t count;
+	};
+	static const uint8_t PRR_MAX_COUNT = 255;
 
 	uint32_t getChunkEntry(Address tag, ChunkInfo * chunk_info, bool allocate=true);
 	bool sampleOrNot(double sample_rate, bool miss_rate_tune = true);
 	bool compareCounter(ChunkEntry * entry1, ChunkEntry * entry2);
 	uint32_t adjustEntryOrder(ChunkInfo * chunk_info, uint32_t idx);
-	uint32_t pickVictimWay(ChunkInfo * chunk_info);
+	uint32_t pickVictimWay(ChunkInfo * chunk_info, uint32_t part);
+	uint32_t getLRUWay(uint64_t set_num, uint32_t part);
 	void handleCounterOverflow(ChunkInfo * chunk_info, ChunkEntry * overflow_entry);
+	// FBR counter table index and victim heap
+	uint32_t getIndexSlot(Address tag) { return (tag * 0x9E3779B97F4A7C15UL) >> (64 - _index_bits); };
+	uint32_t findIndexSlot(ChunkInfo * chunk_info, Address tag);
+	void eraseIndexSlot(ChunkInfo * chunk_info, uint32_t slot);
+	bool heapLess(ChunkInfo * chunk_info, uint32_t way1, uint32_t way2);
+	void fixHeap(ChunkInfo * chunk_info, uint32_t way);
+	void rebuildHeap(ChunkInfo * chunk_info);
+	void rebuildChunk(ChunkInfo * chunk_info);
+	void verifyChunk(ChunkInfo * chunk_info, Set * set);
+	// Probabilistic replacement
+	uint32_t handlePrrMiss(Address tag, uint64_t set_num, Set * set, bool &counter_access, uint32_t part);
+	uint32_t pickPrrVictim(uint64_t set_num, uint32_t part);
+	uint32_t getPrrCount(uint64_t set_num, uint32_t way);
+	void resetPrrCounter(uint64_t set_num, uint32_t way);
 	void computeFreqDistr();
 	void updateLRU(uint64_t set_num, uint32_t way_num);
 	double getCurrSampleRate();
@@ -63,15 +96,24 @@ private:
 	uint32_t _granularity;
 	// Frequency Base Replacement
 	ChunkInfo * _chunks;
+	// Probabilistic replacement, one counter per frame
+	PrrCounter * _prr_counters;
+	uint32_t _prr_epoch;
+	uint64_t _prr_misses;
 	
 	// Parameters
 	uint64_t _num_chunks;
 	uint32_t _num_entries_per_chunk;
+	uint32_t _index_bits;
+	uint32_t _index_size;
 	//uint32_t _num_stable_entries;
 	double _sample_rate;
 	uint32_t _access_count_threshold;
 	uint32_t _max_count_size;
 	bool _enable_replace;
+	double _prr_probability;
+	uint64_t _prr_decay_interval;
+	uint32_t _prr_candidates;
 
 	// Stats
 	uint64_t * _histogram;
@@ -24,6 +24,7 @@
  */
 
 #include "partition_mapper.h"
+#include <string>
 #include "log.h"
 #include "process_tree.h"
 #include "zsim.h"
@@ -52,6 +53,27 @@ uint32_t InstrDataProcessPartMapper::getPartition(const MemReq& req) {
     return procIdx + (instr ? numProcs : 0);
 }
 
+PartMapper* BuildPartMapper(const char* type, const char* name) {
+    std::string partMapper = type;
+    PartMapper* pm = nullptr;
+    if (partMapper == "Core") {
+        pm = new CorePartMapper(zinfo->numCores); //NOTE: If the cache is not fully shared, trhis will be inefficient...
+    } else if (partMapper == "InstrData") {
+        pm = new InstrDataPartMapper();
+    } else if (partMapper == "InstrDataCore") {
+        pm = new InstrDataCorePartMapper(zinfo->numCores);
+    } else if (partMapper == "Process") {
+        pm = new ProcessPartMapper(zinfo->numProcs);
+    } else if (partMapper == "InstrDataProcess") {
+        pm = new InstrDataProcessPartMapper(zinfo->numProcs);
+    } else if (partMapper == "ProcessGroup") {
+        pm = new ProcessGroupPartMapper();
+    } else {
+        panic("Invalid repl.partMapper %s on %s", partMapper.c_str(), name);
+    }
+    return pm;
+}
+
 uint32_t ProcessGroupPartMapper::getNumPartitions() {
     return zinfo->numProcGroups;
 }
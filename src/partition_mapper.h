@@ -86,6 +86,9 @@ class ProcessGroupPartMapper : public PartMapper {
         virtual uint32_t getPartition(const MemReq& req);
 };
 
+// Builds the mapper named by a repl.partMapper-style option; name is only used in error messages
+PartMapper* BuildPartMapper(const char* type, const char* name);
+
 #endif  // PARTITION_MAPPER_H_
 
 
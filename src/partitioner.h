@@ -56,11 +56,14 @@ class Partitioner : public GlobAlloc {
         bool* forbidden;
 };
 
+class PartitionMonitor;
+
 // Gives best partition sizes as estimated with the greedy lookahead
 // algorithm proposed in the UCP paper (Qureshi and Patt, ISCA 2006)
 namespace lookahead {
-    uint64_t computePartitioningTotalUtility(uint32_t numPartitions, const uint32_t* parts, const uint32_t* missCurves);
-    void computeBestPartitioning(uint32_t numPartitions, uint32_t* allocs, uint32_t* missCurves);
+    uint64_t computePartitioningTotalUtility(uint32_t numPartitions, const uint32_t* parts, const PartitionMonitor& monitor);
+    void computeBestPartitioning(uint32_t numPartitions, uint32_t buckets, uint32_t minAlloc, bool* forbidden,
+                                 uint32_t* allocs, const PartitionMonitor& monitor);
 }
 
 class LookaheadPartitioner : public Partitioner {
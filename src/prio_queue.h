@@ -26,7 +26,7 @@
 #ifndef PRIO_QUEUE_H_
 #define PRIO_QUEUE_H_
 
-#include "g_std/g_multimap.h"
+#include "g_std/g_vector.h"
 
 template <typename T, uint32_t B>
 class PrioQueue {
@@ -62,18 +62,78 @@ class PrioQueue {
 
     PQBlock blocks[B];
 
-    typedef g_multimap<uint64_t, T*> FEMap; //far element map
-    typedef typename FEMap::iterator FEMapIterator;
+    /* Far elements (B blocks or more ahead) go into a calendar of FAR_SLOTS
+     * slots, each covering the B/2 blocks moved into blocks[] at once, so
+     * enqueues are appends and every refill drains exactly one slot. Slots keep
+     * insertion order, so same-cycle elements come out in FIFO order, as with
+     * the multimap this replaces. Elements beyond the calendar's horizon wait in
+     * an unsorted overflow list until their slot comes into range.
+     */
+    static const uint32_t FAR_SLOTS = 64;
+    static const uint64_t SLOT_CYCLES = (B/2)*64;
 
-    FEMap feMap;
+    typedef g_vector<std::pair<uint64_t, T*>> FarSlot;
+
+    FarSlot farSlots[FAR_SLOTS];
+    FarSlot overflow;
+    uint64_t farElems; //includes overflow
+    uint64_t farMin; //earliest far cycle, valid if farElems
+    uint64_t overflowMin;
 
     uint64_t curBlock;
     uint64_t elems;
 
+    //Slots hold [curSlot+2, curSlot+FAR_SLOTS], with curSlot = curBlock/(B/2)
+    inline bool inCalendar(uint64_t slot) const {
+        return slot <= curBlock/(B/2) + FAR_SLOTS;
+    }
+
+    //Called when curBlock reaches a multiple of B/2: moves the slot with cycles in [(curBlock+B/2)*64, (curBlock+B)*64) to blocks[]
+    void refill() {
+        uint64_t slot = curBlock/(B/2) + 1;
+        if (!overflow.empty() && inCalendar(overflowMin/SLOT_CYCLES)) {
+            uint32_t kept = 0;
+            overflowMin = -1L;
+            for (auto& e : overflow) {
+                uint64_t s = e.first/SLOT_CYCLES;
+                if (inCalendar(s)) {
+                    assert(s > slot);
+                    farSlots[s % FAR_SLOTS].push_back(e);
+                } else {
+                    overflow[kept++] = e;
+                    overflowMin = MIN(overflowMin, e.first);
+                }
+            }
+            overflow.resize(kept);
+        }
+
+        FarSlot& fs = farSlots[slot % FAR_SLOTS];
+        for (auto& e : fs) {
+            uint64_t absBlock = e.first/64;
+            assert(absBlock >= curBlock);
+            assert(absBlock < curBlock + B);
+            blocks[absBlock % B].enqueue(e.second, e.first % 64);
+        }
+        farElems -= fs.size();
+        fs.clear(); //keeps capacity, so steady-state enqueues do not allocate
+
+        //Recompute farMin from the next populated slot
+        farMin = overflow.empty()? -1L : overflowMin;
+        for (uint64_t s = slot + 1; farElems && inCalendar(s); s++) {
+            FarSlot& next = farSlots[s % FAR_SLOTS];
+            if (next.empty()) continue;
+            for (auto& e : next) farMin = MIN(farMin, e.first);
+            break;
+        }
+    }
+
     public:
         PrioQueue() {
             curBlock = 0;
             elems = 0;
+            farElems = 0;
+            farMin = -1L;
+            overflowMin = -1L;
         }
 
         void enqueue(T* obj, uint64_t cycle) {
@@ -86,7 +146,15 @@ class PrioQueue {
                 blocks[i].enqueue(obj, offset);
             } else {
                 //info("XXX far enq() %ld", cycle);
-                feMap.insert(std::pair<uint64_t, T*>(cycle, obj));
+                uint64_t slot = cycle/SLOT_CYCLES;
+                if (inCalendar(slot)) {
+                    farSlots[slot % FAR_SLOTS].push_back(std::make_pair(cycle, obj));
+                } else {
+                    overflow.push_back(std::make_pair(cycle, obj));
+                    overflowMin = MIN(overflowMin, cycle);
+                }
+                farElems++;
+                farMin = MIN(farMin, cycle);
             }
             elems++;
         }
@@ -95,24 +163,7 @@ class PrioQueue {
             assert(elems);
             while (!blocks[curBlock % B].occ) {
                 curBlock++;
-                if ((curBlock % (B/2)) == 0 && !feMap.empty()) {
-                    uint64_t topCycle = (curBlock + B)*64;
-                    //Move every element with cycle < topCycle to blocks[]
-                    FEMapIterator it = feMap.begin();
-                    while (it != feMap.end() && it->first < topCycle) {
-                        uint64_t cycle = it->first;
-                        T* obj = it->second;
-
-                        uint64_t absBlock = cycle/64;
-                        assert(absBlock >= curBlock);
-                        assert(absBlock < curBlock + B);
-                        uint32_t i = absBlock % B;
-                        uint32_t offset = cycle % 64;
-                        blocks[i].enqueue(obj, offset);
-                        it++;
-                    }
-                    feMap.erase(feMap.begin(), it);
-                }
+                if ((curBlock % (B/2)) == 0 && farElems) refill();
             }
 
             //We're now at the first populated block
@@ -142,11 +193,12 @@ class PrioQueue {
                 if (occ) {
                     uint64_t pos = __builtin_ctzl(occ);
                     uint64_t cycle = (curBlock + i)*64 + pos;
-                    return feMap.empty()? cycle : MIN(cycle, feMap.begin()->first);
+                    return farElems? MIN(cycle, farMin) : cycle;
                 }
             }
 
-            return feMap.begin()->first;
+            assert(farElems);
+            return farMin;
         }
 };
 
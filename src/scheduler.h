@@ -32,6 +32,7 @@
 #include <list>
 #include <sstream>
 #include <vector>
+#include "adaptive_phase.h"
 #include "barrier.h"
 #include "constants.h"
 #include "core.h"
@@ -432,6 +433,7 @@ class Scheduler : public GlobAlloc, public Callee {
             /* End of phase accounting */
             zinfo->numPhases++;
             zinfo->globPhaseCycles += zinfo->phaseLength;
+            if (zinfo->phaseCtrl) zinfo->phaseCtrl->advancePhase();
             curPhase++;
 
             assert(curPhase == zinfo->numPhases); //check they don't skew
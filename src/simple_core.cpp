@@ -44,7 +44,7 @@ void SimpleCore::initStats(AggregateStat* parentStat) {
 }
 
 uint64_t SimpleCore::getPhaseCycles() const {
-    return curCycle % zinfo->phaseLength;
+    return (curCycle > zinfo->globPhaseCycles)? curCycle - zinfo->globPhaseCycles : 0;
 }
 
 void SimpleCore::load(Address addr) {
@@ -114,7 +114,7 @@ void SimpleCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
 
     while (core->curCycle > core->phaseEndCycle) {
         assert(core->phaseEndCycle == zinfo->globPhaseCycles + zinfo->phaseLength);
-        core->phaseEndCycle += zinfo->phaseLength;
+        core->phaseEndCycle += zinfo->nextPhaseLength;
 
         uint32_t cid = getCid(tid);
         //NOTE: TakeBarrier may take ownership of the core, and so it will be used by some other thread. If TakeBarrier context-switches us,
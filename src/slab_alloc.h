@@ -33,6 +33,11 @@
  * are garbage-collected once all their events are done. To do this without space
  * overheads, slabs are carefully aligned, so that objects inside the slab can
  * derive the pointer of their slab.
+ *
+ * Events are freed in the weave phase, often several in a row from the same
+ * slab. A FreeBatch accumulates those frees and applies them with a single
+ * atomic op when the slab changes or when the batch is flushed at the end of
+ * the phase; deferring frees only delays slab reuse.
  */
 
 #include <deque>
@@ -89,6 +94,7 @@ struct Slab {  // POD type (no constructor)
     }
 
     inline void freeElem();
+    inline void freeElems(uint32_t elems);
 };
 
 class SlabAlloc {
@@ -98,8 +104,13 @@ class SlabAlloc {
         uint32_t liveSlabs;
         mutex freeLock;  // used because slab frees may be concurrent
 
+        // Stats, read racily
+        uint64_t allocBytes;
+        uint32_t totalSlabs;
+        uint64_t reclaims;
+
     public:
-        SlabAlloc() : curSlab(nullptr), liveSlabs(0) {
+        SlabAlloc() : curSlab(nullptr), liveSlabs(0), allocBytes(0), totalSlabs(0), reclaims(0) {
             allocSlab();
         }
 
@@ -112,11 +123,17 @@ class SlabAlloc {
                 assert(ptr);
             }
             assert((((uintptr_t)ptr) & SLAB_MASK) == (uintptr_t)curSlab)
+            allocBytes += sz;
             return ptr;
         }
 
         template <typename T> T* alloc() { return (T*)alloc(sizeof(T)); }
 
+        uint64_t getAllocBytes() const { return allocBytes; }
+        uint32_t getTotalSlabs() const { return totalSlabs; }
+        uint32_t getLiveSlabs() const { return liveSlabs; }
+        uint64_t getReclaims() const { return reclaims; }
+
     private:
         void allocSlab() {
             scoped_mutex sm(freeLock);
@@ -129,6 +146,7 @@ class SlabAlloc {
                 curSlab = gm_memalign<Slab>(sizeof(Slab));
                 assert((((uintptr_t)curSlab) & SLAB_MASK) == (uintptr_t)curSlab);
                 curSlab->init(this);  // NOTE: Slab is POD
+                totalSlabs++;
             }
             liveSlabs++;
             //info("allocated slab %p, %d live, %ld in freeList", curSlab, liveSlabs, freeList.size());
@@ -145,6 +163,7 @@ class SlabAlloc {
                 freeList.push_back(s);
                 liveSlabs--;
             }
+            reclaims++;
             assert(liveSlabs);  // at least curSlab
         }
 
@@ -160,6 +179,14 @@ inline void Slab::freeElem() {
     }
 }
 
+inline void Slab::freeElems(uint32_t elems) {
+    uint32_t prevLiveElems = __sync_fetch_and_sub(&liveElems, elems);
+    assert(prevLiveElems >= elems && prevLiveElems < usedBytes);
+    if (prevLiveElems == elems) {
+        allocator->freeSlab(this);
+    }
+}
+
 inline void freeElem(void* elem, size_t minSz) {
 #ifdef DEBUG_SLAB_ALLOC
     memset(elem, 0, minSz);
@@ -168,6 +195,43 @@ inline void freeElem(void* elem, size_t minSz) {
     s->freeElem();
 }
 
+// Pending frees to a single slab; must only be used by one thread at a time
+struct FreeBatch {  // POD type (no constructor)
+    Slab* slab;
+    uint32_t elems;
+    uint64_t frees;
+    uint64_t flushes;
+
+    void init() {
+        slab = nullptr;
+        elems = 0;
+        frees = 0;
+        flushes = 0;
+    }
+
+    inline void freeElem(void* elem, size_t minSz) {
+#ifdef DEBUG_SLAB_ALLOC
+        memset(elem, 0, minSz);
+#endif
+        Slab* s = (Slab*)(((uintptr_t)elem) & SLAB_MASK);
+        if (s != slab) {
+            flush();
+            slab = s;
+        }
+        elems++;
+        frees++;
+    }
+
+    void flush() {
+        if (elems) {
+            slab->freeElems(elems);
+            flushes++;
+        }
+        slab = nullptr;
+        elems = 0;
+    }
+};
+
 };  // namespace slab
 
 #endif  // SLAB_ALLOC_H_
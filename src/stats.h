@@ -298,6 +298,16 @@ class VectorCounter : public VectorStat {
         }
 };
 
+// Max over mean of a vector stat, in thousandths (1000 is perfectly balanced, 0 if empty)
+static inline uint64_t vectorImbalance(const VectorStat& v) {
+    uint64_t total = 0, max = 0;
+    for (uint32_t i = 0; i < v.size(); i++) {
+        total += v.count(i);
+        if (v.count(i) > max) max = v.count(i);
+    }
+    return total? 1000 * max * v.size() / total : 0;
+}
+
 /*
 class Histogram : public Stat {
     //TBD
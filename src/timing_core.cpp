@@ -34,7 +34,7 @@ TimingCore::TimingCore(FilterCache* _l1i, FilterCache* _l1d, uint32_t _domain, g
     : Core(_name), l1i(_l1i), l1d(_l1d), instrs(0), curCycle(0), cRec(_domain, _name) {}
 
 uint64_t TimingCore::getPhaseCycles() const {
-    return curCycle % zinfo->phaseLength;
+    return (curCycle > zinfo->globPhaseCycles)? curCycle - zinfo->globPhaseCycles : 0;
 }
 
 void TimingCore::initStats(AggregateStat* parentStat) {
@@ -119,7 +119,7 @@ void TimingCore::BblAndRecordFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInf
     core->bblAndRecord(bblAddr, bblInfo);
 
     while (core->curCycle > core->phaseEndCycle) {
-        core->phaseEndCycle += zinfo->phaseLength;
+        core->phaseEndCycle += zinfo->nextPhaseLength;
         uint32_t cid = getCid(tid);
         uint32_t newCid = TakeBarrier(tid, cid);
         if (newCid != cid) break; /*context-switch*/
@@ -42,6 +42,26 @@ void TimingEvent::parentDone(uint64_t startCycle) {
     }
 }
 
+// Events are freed by the thread simulating their domain, so frees go through
+// the domain's FreeBatch, which ContentionSim flushes at the end of the phase
+void TimingEvent::freeEvent() {
+    slab::FreeBatch* batch = zinfo->contentionSim->getFreeBatch(domain);
+    // Free timing event blocks and ourselves
+    if (numChildren > 1) {
+        TimingEventBlock* teb = children;
+        while (teb) {
+            TimingEventBlock* next = teb->next;
+            if (batch) batch->freeElem((void*)teb, sizeof(teb));
+            else slab::freeElem((void*)teb, sizeof(teb));
+            teb = next;
+        }
+        children = nullptr;
+        numChildren = 0;
+    }
+    if (batch) batch->freeElem((void*)this, sizeof(TimingEvent));
+    else slab::freeElem((void*)this, sizeof(TimingEvent));
+}
+
 void TimingEvent::queue(uint64_t nextCycle) {
     assert(state == EV_NONE && numParents == 0);
     state = EV_QUEUED;
@@ -254,20 +254,7 @@ class TimingEvent {
 
         void checkDomain(TimingEvent* ch);
 
-        void freeEvent() {
-            // Free timing event blocks and ourselves
-            if (numChildren > 1) {
-                TimingEventBlock* teb = children;
-                while (teb) {
-                    TimingEventBlock* next = teb->next;
-                    slab::freeElem((void*)teb, sizeof(teb));
-                    teb = next;
-                }
-                children = nullptr;
-                numChildren = 0;
-            }
-            slab::freeElem((void*)this, sizeof(TimingEvent));
-        }
+        void freeEvent();  // see cpp
 
     protected:
 
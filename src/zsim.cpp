@@ -44,6 +44,7 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include "access_tracing.h"
+#include "adaptive_phase.h"
 #include "constants.h"
 #include "contention_sim.h"
 #include "core.h"
@@ -54,6 +55,7 @@
 #include "galloc.h"
 #include "init.h"
 #include "log.h"
+#include "mc.h"
 #include "pin.H"
 #include "pin_cmd.h"
 #include "process_tree.h"
@@ -253,6 +255,54 @@ VOID FFBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
     }
 }
 
+// FF with DRAM cache warm-up: like FF, but loads/stores of a thread go through a direct-mapped
+// functional filter cache that stands in for the SRAM hierarchy, so only its misses (as loads) and
+// dirty evictions (as stores) reach the DRAM cache, like the GETS/GETX and PUTX it sees when
+// simulating. Every ffWarmupPeriod-th of those updates the DRAM cache state. The filter is private
+// to the thread, so lines shared between threads reach the DRAM cache more often than through a
+// shared LLC. Addresses are mapped as with the filter cache TLB off.
+struct FFWarmupLine {
+    Address lineAddr;
+    bool valid;
+    bool dirty;
+};
+
+static FFWarmupLine* ffWarmupFilter[MAX_THREADS];
+static uint32_t ffWarmupCount[MAX_THREADS];
+
+static inline void FFWarmupMemAccess(THREADID tid, Address lineAddr, bool isStore) {
+    if (unlikely(++ffWarmupCount[tid] >= zinfo->ffWarmupPeriod)) {
+        ffWarmupCount[tid] = 0;
+        zinfo->ffWarmupMem->functionalAccess(lineAddr, isStore);
+    }
+}
+
+static inline void FFWarmupAccess(THREADID tid, ADDRINT addr, bool isStore) {
+    Address lineAddr = procMask | (addr >> lineBits);
+    uint32_t numLines = zinfo->ffWarmupFilterLines;
+    if (!numLines) {
+        FFWarmupMemAccess(tid, lineAddr, isStore);
+        return;
+    }
+    if (unlikely(!ffWarmupFilter[tid])) ffWarmupFilter[tid] = gm_calloc<FFWarmupLine>(numLines);
+
+    FFWarmupLine& line = ffWarmupFilter[tid][(lineAddr ^ (lineAddr >> ilog2(numLines))) & (numLines - 1)];
+    if (likely(line.valid && line.lineAddr == lineAddr)) {
+        line.dirty |= isStore;
+        return;
+    }
+    if (line.valid && line.dirty) FFWarmupMemAccess(tid, line.lineAddr, true);
+    FFWarmupMemAccess(tid, lineAddr, false);
+    line.lineAddr = lineAddr;
+    line.valid = true;
+    line.dirty = isStore;
+}
+
+VOID FFWarmupLoadSingle(THREADID tid, ADDRINT addr) { FFWarmupAccess(tid, addr, false); }
+VOID FFWarmupStoreSingle(THREADID tid, ADDRINT addr) { FFWarmupAccess(tid, addr, true); }
+VOID FFWarmupPredLoadSingle(THREADID tid, ADDRINT addr, BOOL pred) { if (pred) FFWarmupAccess(tid, addr, false); }
+VOID FFWarmupPredStoreSingle(THREADID tid, ADDRINT addr, BOOL pred) { if (pred) FFWarmupAccess(tid, addr, true); }
+
 // FFI is instruction-based fast-forwarding
 /* FFI works as follows: when in fast-forward, we install a special FF BBL func
  * ptr that counts instructions and checks whether we have reached the switch
@@ -302,7 +352,7 @@ VOID FFITrackNFFInterval() {
         *_ffiPrevFFStartInstrs = *_ffiFFStartInstrs;
         *_ffiFFStartInstrs = zinfo->processStats->getProcessInstrs(p);
     };
-    zinfo->eventQueue->insert(makeAdaptiveEvent(ffiGet, ffiFire, 0, ffiInstrsLimit - ffiInstrsDone, MAX_IPC*zinfo->phaseLength));
+    zinfo->eventQueue->insert(makeAdaptiveEvent(ffiGet, ffiFire, 0, ffiInstrsLimit - ffiInstrsDone, MAX_IPC*zinfo->maxPhaseLength));
 
     ffiNFF = true;
 }
@@ -370,12 +420,14 @@ static const InstrFuncPtrs joinPtrs = {JoinAndLoadSingle, JoinAndStoreSingle, Jo
 static const InstrFuncPtrs nopPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, NOPBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
 static const InstrFuncPtrs retryPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, NOPBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_RETRY};
 static const InstrFuncPtrs ffPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
+static const InstrFuncPtrs ffWarmupPtrs = {FFWarmupLoadSingle, FFWarmupStoreSingle, FFBasicBlock, NOPRecordBranch, FFWarmupPredLoadSingle, FFWarmupPredStoreSingle, FPTR_NOP};
 
 static const InstrFuncPtrs ffiPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFIBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
 static const InstrFuncPtrs ffiEntryPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFIEntryBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
 
 static const InstrFuncPtrs& GetFFPtrs() {
-    return ffiEnabled? (ffiNFF? ffiEntryPtrs : ffiPtrs) : ffPtrs;
+    if (ffiEnabled) return ffiNFF? ffiEntryPtrs : ffiPtrs;
+    return zinfo->ffWarmup? ffWarmupPtrs : ffPtrs;
 }
 
 //Fast-forwarding
@@ -492,6 +544,10 @@ VOID EndOfPhaseActions() {
 
     CheckForTermination();
     zinfo->contentionSim->simulatePhase(zinfo->globPhaseCycles + zinfo->phaseLength);
+    if (zinfo->phaseCtrl) zinfo->phaseCtrl->phaseDone();
+    if (unlikely(zinfo->warmStateSavePhase && zinfo->numPhases + 1 == zinfo->warmStateSavePhase)) {
+        SaveDramCacheWarmState(zinfo->warmStateSaveFile);
+    }
     zinfo->eventQueue->tick();
     zinfo->profSimTime->transition(PROF_BOUND);
 }
@@ -1117,6 +1173,7 @@ VOID SimEnd() {
         zinfo->trigger = 20000;
         for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false /*unbuffered, write out*/);
         for (AccessTraceWriter* t : *(zinfo->traceWriters)) t->dump(false);  // flushes trace writer
+        for (MemoryController* mc : *(zinfo->dramCaches)) mc->flushIntervals();
 
         if (zinfo->sched) zinfo->sched->notifyTermination();
     }
@@ -1136,6 +1193,7 @@ VOID SimEnd() {
 #define ZSIM_MAGIC_OP_ROI_END           (1026)
 #define ZSIM_MAGIC_OP_REGISTER_THREAD   (1027)
 #define ZSIM_MAGIC_OP_HEARTBEAT         (1028)
+#define ZSIM_MAGIC_OP_SAVE_WARM_STATE   (1034)
 
 VOID HandleMagicOp(THREADID tid, ADDRINT op) {
     switch (op) {
@@ -1194,6 +1252,11 @@ VOID HandleMagicOp(THREADID tid, ADDRINT op) {
             procTreeNode->heartbeat(); //heartbeats are per process for now
             return;
 
+        case ZSIM_MAGIC_OP_SAVE_WARM_STATE:
+            info("Thread %d: saving DRAM cache warm state", tid);
+            SaveDramCacheWarmState(zinfo->warmStateSaveFile);
+            return;
+
         // HACK: Ubik magic ops
         case 1029:
         case 1030:
@@ -1562,6 +1625,7 @@ int main(int argc, char *argv[]) {
             EndOfPhaseActions();
             zinfo->numPhases++;
             zinfo->globPhaseCycles += zinfo->phaseLength;
+            if (zinfo->phaseCtrl) zinfo->phaseCtrl->advancePhase();
         }
         info("Finished trace-driven simulation");
         SimEnd();
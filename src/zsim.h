@@ -48,6 +48,9 @@ class PortVirtualizer;
 class VectorCounter;
 class AccessTraceWriter;
 class TraceDriver;
+class MemoryController;
+class MemObject;
+class AdaptivePhaseController;
 template <typename T> class g_vector;
 
 struct ClockDomainInfo {
@@ -94,6 +97,9 @@ struct GlobSimInfo {
 
     //World-readable
     uint32_t phaseLength;
+    uint32_t nextPhaseLength; //cores set their next phase end with this; differs from phaseLength only with adaptive phases
+    uint32_t maxPhaseLength;
+    AdaptivePhaseController* phaseCtrl; //null unless sim.adaptivePhase
     uint32_t statsPhaseInterval;
     uint32_t freqMHz;
 
@@ -113,7 +119,7 @@ struct GlobSimInfo {
 
     //Writable, rarely read, unshared in a single phase
     uint64_t numPhases;
-    uint64_t globPhaseCycles; //just numPhases*phaseCycles. It behooves us to precompute it, since it is very frequently used in tracing code.
+    uint64_t globPhaseCycles; //numPhases*phaseCycles with fixed-length phases; the sum of phase lengths with sim.adaptivePhase. It behooves us to precompute it, since it is very frequently used in tracing code.
 
     uint64_t procEventualDumps;
 
@@ -181,6 +187,19 @@ struct GlobSimInfo {
     // Trace-driven simulation (no cores)
     bool traceDriven;
     TraceDriver* traceDriver;
+
+    // DRAM cache controllers, stored globally for warm-state checkpoints
+    g_vector<MemoryController*>* dramCaches;
+    const char* warmStateSaveFile; //written on the SAVE_WARM_STATE magic op or at warmStateSavePhase
+    uint64_t warmStateSavePhase; //0 disables the phase trigger
+
+    // Fast-forward DRAM cache warm-up: loads/stores go through a per-thread functional filter cache of
+    // ffWarmupFilterLines lines (0 disables it), and every ffWarmupPeriod-th miss or dirty eviction
+    // is applied functionally to ffWarmupMem
+    bool ffWarmup;
+    uint32_t ffWarmupFilterLines;
+    uint32_t ffWarmupPeriod;
+    MemObject* ffWarmupMem;
 };
 
 